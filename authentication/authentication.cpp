@@ -0,0 +1,196 @@
+#include "authentication/authentication.h"
+
+bool isValidNewUser(const std::string& userName, const std::string& normalizedDir, bool isAdmin)
+{
+    if (userName.length() > 50) {
+        std::cout << "Error: Username is too long." << std::endl;
+        return false;
+    }
+    if (!isAdmin && userName == "admin") {
+        std::cout << "Error: Invalid Username." << std::endl;
+        return false;
+    }
+
+    std::regex validUsernameRegex("^[a-zA-Z0-9]*$");
+    if (!std::regex_match(userName, validUsernameRegex)) {
+        std::cout << "Error: Username contains invalid characters." << std::endl;
+        return false;
+    }
+
+    // Check if user already exists
+    std::string publicKeyPath = normalizedDir + "key/public_keys/" + userName + ".pub";
+    std::string privateKeyPath = normalizedDir + "key/private_keys/" + userName + "_keyfile";
+    if (std::filesystem::exists(publicKeyPath) || std::filesystem::exists(privateKeyPath)) {
+        std::cout << "User " << userName << " already exists." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+KeyPool* configuredKeyPool(const std::string& directory)
+{
+    return KeyPool::ConfiguredSize() > 0 ? &KeyPool::Instance(directory) : nullptr;
+}
+
+void createUserKeys(const std::string& userName, const std::string& normalizedDir, KeyPool* pool)
+{
+    std::string publicKeyPath = normalizedDir + "key/public_keys/" + userName + ".pub";
+    std::string privateKeyPath = normalizedDir + "key/private_keys/" + userName + "_keyfile";
+    PooledKeys keys;
+    if (pool != nullptr && pool->Take(keys)) {
+        SshKey::writeKeyPair(privateKeyPath, publicKeyPath, keys.private_key, keys.public_key);
+    } else {
+        SshKey::generateRsaKeyPair(privateKeyPath, publicKeyPath, "created_by_encrypted_fs");
+        keys.metadata_key.resize(KEY_SIZE);
+        if (1 != RAND_bytes(keys.metadata_key.data(), KEY_SIZE)) {
+            throw std::runtime_error("Failed to generate user metadata key");
+        }
+    }
+
+    std::ofstream file(normalizedDir + "common/" + userName + "_key", std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to create user metadata key file");
+    }
+    file.write((char *) keys.metadata_key.data(), KEY_SIZE);
+    file.close();
+}
+
+void addUser(const std::string& userName, std::string directory, bool isAdmin)
+{
+    std::string normalizedDir = directory + "/";
+    if (!isValidNewUser(userName, normalizedDir, isAdmin)) {
+        return;
+    }
+
+    try {
+        createUserKeys(userName, normalizedDir, configuredKeyPool(normalizedDir));
+        std::cout << "User " << userName << " added successfully." << std::endl;
+        UserRegistry::Instance(directory).Add(userName);
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << std::endl;
+        return;
+    }
+    createInitFsForUser(userName, normalizedDir);
+}
+
+size_t addUsers(const std::vector<std::string>& userNames, std::string directory)
+{
+    std::string normalizedDir = directory + "/";
+    std::vector<std::string> candidates;
+    std::unordered_set<std::string> seen;
+    for (const std::string& userName : userNames) {
+        if (!seen.insert(userName).second) {
+            std::cout << "User " << userName << " already exists." << std::endl;
+        } else if (isValidNewUser(userName, normalizedDir, false)) {
+            candidates.push_back(userName);
+        }
+    }
+
+    // Looked up once here, the workers below only use it
+    KeyPool* pool = configuredKeyPool(normalizedDir);
+    std::vector<std::string> errors(candidates.size());
+    auto createKeys = [&](size_t i) {
+        try {
+            createUserKeys(candidates[i], normalizedDir, pool);
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+        }
+    };
+    if (Encryption::workerCount() > 1 && candidates.size() > 1) {
+        Encryption::workerPool().parallelFor(candidates.size(), createKeys);
+    } else {
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            createKeys(i);
+        }
+    }
+
+    std::vector<std::string> added;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (errors[i].empty()) {
+            std::cout << "User " << candidates[i] << " added successfully." << std::endl;
+            added.push_back(candidates[i]);
+        } else {
+            std::cout << "Error: " << errors[i] << std::endl;
+        }
+    }
+    if (added.empty()) {
+        return 0;
+    }
+
+    try {
+        UserRegistry::Instance(directory).Add(added);
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << std::endl;
+        return 0;
+    }
+    createInitFsForUsers(added, normalizedDir);
+    return added.size();
+}
+
+bool readUserNames(const std::string& userFile, std::vector<std::string>& userNames)
+{
+    std::ifstream file(userFile);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string userName;
+    while (file >> userName) {
+        userNames.push_back(userName);
+    }
+    return true;
+}
+
+bool isValidKeyfile(const std::string& userName)
+{
+    // Define paths for the user's private and public keys
+    std::filesystem::path privateKeyPath = "key/private_keys/" + userName + "_keyfile";
+    std::filesystem::path publicKeyPath = "key/public_keys/" + userName + ".pub";
+
+    // Derive the expected public key from the private key file, as `ssh-keygen -y` would
+    std::string expectedPublicKey;
+    if (!SshKey::derivePublicKey(privateKeyPath, expectedPublicKey)) {
+        return false;
+    }
+
+    // Read the actual public key from file
+    std::ifstream publicKeyFile(publicKeyPath);
+    std::string actualPublicKey((std::istreambuf_iterator<char>(publicKeyFile)), std::istreambuf_iterator<char>());
+
+    // Verify the public key is correctly generated by the system
+    bool isCreatedByEncryptedFs = actualPublicKey.find("created_by_encrypted_fs") != std::string::npos;
+
+    // Check if the user is listed in the system's user list
+    bool isUserListed = UserRegistry::Instance(fs::current_path()).Contains(userName);
+    // The keyfile is valid if the extracted public key matches the stored one, it's correctly flagged, and the user is listed
+    return expectedPublicKey == actualPublicKey && isCreatedByEncryptedFs && isUserListed;
+}
+
+bool resolveKeyfileUser(const std::string& keyFileName, std::string& userName)
+{
+    struct stat fileInfo;
+    std::string privateKeyPath = "key/private_keys/" + keyFileName;
+    if (stat(privateKeyPath.c_str(), &fileInfo) != 0) {
+        return false;
+    }
+
+    // Extract username from the keyfile name by removing the suffix and any spaces
+    userName = keyFileName.substr(0, keyFileName.find_first_of("_ "));
+
+    // Validate the keyfile based on the extracted username
+    return isValidKeyfile(userName);
+}
+
+std::string getTypeOfUser(const std::string& keyFileName, bool announce)
+{
+    std::string userName;
+    if (resolveKeyfileUser(keyFileName, userName)) {
+        if (announce) {
+            std::cout << "Logged in as " << userName << std::endl;
+        }
+        return userName;
+    }
+
+    // If validation fails, report an invalid keyfile and terminate the program
+    std::cerr << "Invalid keyfile" << std::endl;
+    exit(EXIT_FAILURE); // Consider throwing an exception instead of exiting
+}
@@ -0,0 +1,213 @@
+#include "authentication/key_pool.h"
+
+/// Get the pool for a filesystem root, creating it on first use
+/// \param filesystem_path    The filesystem root containing key/
+KeyPool& KeyPool::Instance(const std::string& filesystem_path) {
+    static std::mutex instances_mutex;
+    static std::unordered_map<std::string, std::unique_ptr<KeyPool>> instances;
+
+    fs::path root = fs::absolute(filesystem_path).lexically_normal();
+    if (root.filename().empty()) {
+        root = root.parent_path();
+    }
+
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    auto it = instances.find(root.string());
+    if (it == instances.end()) {
+        std::unique_ptr<KeyPool> pool(new KeyPool(root));
+        it = instances.emplace(root.string(), std::move(pool)).first;
+    }
+    return *it->second;
+}
+
+/// \return The target pool size from SECFS_KEY_POOL_SIZE, or 0 if the pool is disabled
+size_t KeyPool::ConfiguredSize() {
+    const char* configured = std::getenv("SECFS_KEY_POOL_SIZE");
+    if (configured == nullptr) {
+        return 0;
+    }
+    char* end = nullptr;
+    unsigned long size = std::strtoul(configured, &end, 10);
+    return end != configured && *end == '\0' ? size : 0;
+}
+
+KeyPool::KeyPool(const fs::path& root_path)
+    : pool_path_(root_path / "key" / "pool") {}
+
+KeyPool::~KeyPool() {
+    Stop();
+    OPENSSL_cleanse(admin_key_.data(), admin_key_.size());
+}
+
+/// Allow Take to draw from the pool; entries can only be read with the admin key
+void KeyPool::Open(const std::vector<uint8_t>& admin_key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    admin_key_ = admin_key;
+    std::error_code error;
+    fs::create_directories(pool_path_, error);
+}
+
+/// Start the background thread that keeps `target_size` entries in the pool; Open must be called first
+void KeyPool::StartRefill(size_t target_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (admin_key_.empty() || target_size == 0 || refill_thread_.joinable()) {
+        return;
+    }
+    target_size_ = target_size;
+    stopping_ = false;
+    refill_thread_ = std::thread(&KeyPool::RefillLoop, this);
+}
+
+/// Stop refilling; an entry being generated is finished first so the pool never holds a partial one
+void KeyPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (refill_thread_.joinable()) {
+        refill_thread_.join();
+    }
+}
+
+/// Claim one entry from the pool
+/// \param keys    Filled with the pooled key pair and metadata key
+/// \return        false if the pool is closed or empty, the caller then generates keys itself
+bool KeyPool::Take(PooledKeys& keys) {
+    std::vector<uint8_t> admin_key;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (admin_key_.empty()) {
+            return false;
+        }
+        admin_key = admin_key_;
+    }
+
+    std::error_code error;
+    for (fs::directory_iterator it(pool_path_, error), end; !error && it != end; it.increment(error)) {
+        const fs::path entry = it->path();
+        if (entry.extension() != KEY_POOL_ENTRY_SUFFIX) {
+            continue;
+        }
+        // Whoever renames the entry first owns it, whichever thread or process that is
+        fs::path claimed = entry;
+        claimed += ".claimed." + std::to_string(::getpid());
+        if (::rename(entry.c_str(), claimed.c_str()) != 0) {
+            continue;
+        }
+
+        std::string content;
+        try {
+            content = Encryption::decryptFile(claimed.string(), admin_key);
+        } catch (const std::exception&) {
+            content.clear();
+        }
+        fs::remove(claimed, error);
+        wake_.notify_all();
+
+        if (content.size() < KEY_SIZE + KEY_POOL_LENGTH_SIZE) {
+            OPENSSL_cleanse(&content[0], content.size());
+            continue;
+        }
+        uint32_t private_length = 0;
+        for (size_t i = 0; i < KEY_POOL_LENGTH_SIZE; ++i) {
+            private_length = (private_length << 8) | static_cast<unsigned char>(content[KEY_SIZE + i]);
+        }
+        size_t private_offset = KEY_SIZE + KEY_POOL_LENGTH_SIZE;
+        if (content.size() - private_offset <= private_length) {
+            OPENSSL_cleanse(&content[0], content.size());
+            continue;
+        }
+        keys.metadata_key.assign(content.begin(), content.begin() + KEY_SIZE);
+        keys.private_key = content.substr(private_offset, private_length);
+        keys.public_key = content.substr(private_offset + private_length);
+        OPENSSL_cleanse(&content[0], content.size());
+        OPENSSL_cleanse(admin_key.data(), admin_key.size());
+        return true;
+    }
+    OPENSSL_cleanse(admin_key.data(), admin_key.size());
+    return false;
+}
+
+void KeyPool::RefillLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (CountEntries() >= target_size_) {
+            // Take wakes us after claiming an entry; the timeout notices other processes draining the pool
+            wake_.wait_for(lock, std::chrono::seconds(5));
+            continue;
+        }
+        lock.unlock();
+        try {
+            AddEntry();
+        } catch (const std::exception&) {
+            // Adding users still works without the pool, try again later
+            lock.lock();
+            wake_.wait_for(lock, std::chrono::seconds(5));
+            continue;
+        }
+        lock.lock();
+    }
+}
+
+// Entry plaintext: metadata key | uint32 private key length | private key | public key
+void KeyPool::AddEntry() {
+    std::string private_key, public_key;
+    SshKey::generateRsaKeyPairText(private_key, public_key, "created_by_encrypted_fs");
+
+    std::string content(KEY_SIZE, '\0');
+    if (1 != RAND_bytes(reinterpret_cast<unsigned char*>(&content[0]), KEY_SIZE)) {
+        OPENSSL_cleanse(&private_key[0], private_key.size());
+        throw std::runtime_error("Failed to generate user metadata key");
+    }
+    uint32_t private_length = static_cast<uint32_t>(private_key.size());
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        content.push_back(static_cast<char>((private_length >> shift) & 0xff));
+    }
+    content += private_key;
+    content += public_key;
+    OPENSSL_cleanse(&private_key[0], private_key.size());
+
+    unsigned char id[16];
+    if (1 != RAND_bytes(id, sizeof(id))) {
+        OPENSSL_cleanse(&content[0], content.size());
+        throw std::runtime_error("Failed to generate pool entry name");
+    }
+    std::string name;
+    for (unsigned char byte : id) {
+        static const char digits[] = "0123456789abcdef";
+        name += digits[byte >> 4];
+        name += digits[byte & 0xf];
+    }
+
+    std::vector<uint8_t> admin_key;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        admin_key = admin_key_;
+    }
+
+    // Written under a name Take ignores, then published with an atomic rename
+    fs::path staging = pool_path_ / (name + ".tmp");
+    try {
+        Encryption::encryptFile(staging.string(), content, admin_key);
+    } catch (...) {
+        OPENSSL_cleanse(&content[0], content.size());
+        OPENSSL_cleanse(admin_key.data(), admin_key.size());
+        throw;
+    }
+    OPENSSL_cleanse(&content[0], content.size());
+    OPENSSL_cleanse(admin_key.data(), admin_key.size());
+    fs::permissions(staging, fs::perms::owner_read | fs::perms::owner_write);
+    fs::rename(staging, pool_path_ / (name + KEY_POOL_ENTRY_SUFFIX));
+}
+
+size_t KeyPool::CountEntries() const {
+    size_t count = 0;
+    std::error_code error;
+    for (fs::directory_iterator it(pool_path_, error), end; !error && it != end; it.increment(error)) {
+        if (it->path().extension() == KEY_POOL_ENTRY_SUFFIX) {
+            ++count;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,74 @@
+/*
+* Key Pool: Keeps user key material generated ahead of time so adding a user doesn't wait on RSA generation.
+* Each entry in key/pool is one RSA key pair plus one 256-bit metadata key, encrypted under the admin key.
+* A background thread tops the pool up to its target size; entries are claimed by renaming them, so several
+* processes can draw from the same pool without handing out the same keys twice.
+* The pool is off unless SECFS_KEY_POOL_SIZE is set to a positive number.
+*/
+
+#ifndef KEY_POOL_H
+#define KEY_POOL_H
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "authentication/ssh_key.h"
+#include "encryption/encryption.h"
+
+namespace fs = std::filesystem;
+
+#define KEY_POOL_ENTRY_SUFFIX ".entry"
+#define KEY_POOL_LENGTH_SIZE 4 //bytes, big-endian length of the private key in an entry
+
+struct PooledKeys {
+    std::string private_key;
+    std::string public_key;
+    std::vector<uint8_t> metadata_key;
+
+    ~PooledKeys() {
+        OPENSSL_cleanse(&private_key[0], private_key.size());
+        OPENSSL_cleanse(metadata_key.data(), metadata_key.size());
+    }
+};
+
+class KeyPool {
+public:
+    static KeyPool& Instance(const std::string& filesystem_path);
+    static size_t ConfiguredSize();
+
+    void Open(const std::vector<uint8_t>& admin_key);
+    void StartRefill(size_t target_size);
+    void Stop();
+    bool Take(PooledKeys& keys);
+
+    ~KeyPool();
+
+private:
+    explicit KeyPool(const fs::path& root_path);
+    void RefillLoop();
+    void AddEntry();
+    size_t CountEntries() const;
+
+    fs::path pool_path_;
+    std::vector<uint8_t> admin_key_;
+    size_t target_size_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread refill_thread_;
+    bool stopping_ = false;
+};
+
+#endif // KEY_POOL_H
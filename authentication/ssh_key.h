@@ -0,0 +1,61 @@
+/*
+* SSH Keys: Generates the RSA key pairs that serve as user keyfiles, in the same on-disk format as
+* `ssh-keygen -t rsa -m OpenSSH`, without spawning ssh-keygen.
+*
+* Private key (PEM armored "OPENSSH PRIVATE KEY", unencrypted):
+*   "openssh-key-v1\0" | string "none" | string "none" | string "" | uint32 1 | string public key blob |
+*   string { uint32 check | uint32 check | string "ssh-rsa" | mpint n, e, d, iqmp, p, q | string comment | padding }
+* Public key:
+*   "ssh-rsa " base64(string "ssh-rsa" | mpint e | mpint n) " " comment
+* The public key can be derived back from the private key file, which is how keyfiles are validated at login.
+*/
+
+#ifndef SSH_KEY_H
+#define SSH_KEY_H
+
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <cstdint>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define SSH_RSA_KEY_BITS 2048
+#define SSH_PRIVATE_KEY_BLOCK_SIZE 8 //bytes, cipher block size for unencrypted keys
+#define SSH_PRIVATE_KEY_LINE_LENGTH 70 //characters
+
+class SshKey {
+public:
+    static void generateRsaKeyPair(const std::string& privateKeyPath, const std::string& publicKeyPath,
+                                   const std::string& comment, int bits = SSH_RSA_KEY_BITS);
+    static void generateRsaKeyPairText(std::string& privateKey, std::string& publicKey,
+                                       const std::string& comment, int bits = SSH_RSA_KEY_BITS);
+    static void writeKeyPair(const std::string& privateKeyPath, const std::string& publicKeyPath,
+                             const std::string& privateKey, const std::string& publicKey);
+    static bool derivePublicKey(const std::string& privateKeyPath, std::string& publicKey);
+
+private:
+    using BigNum = std::unique_ptr<BIGNUM, decltype(&BN_clear_free)>;
+
+    static BigNum getParam(const EVP_PKEY* pkey, const char* name);
+    static void appendUint32(std::string& buffer, uint32_t value);
+    static void appendString(std::string& buffer, const std::string& value);
+    static void appendMpint(std::string& buffer, const BIGNUM* number);
+    static bool readUint32(const std::string& buffer, size_t& position, uint32_t& value);
+    static bool readString(const std::string& buffer, size_t& position, std::string& value);
+    static bool parsePrivateKey(const std::string& decoded, std::string& publicBlob, std::string& comment);
+    static std::string base64(const std::string& data);
+    static bool decodeBase64(const std::string& encoded, std::string& data);
+    static void writeFile(const std::string& path, const std::string& content, mode_t mode);
+};
+
+#endif // SSH_KEY_H
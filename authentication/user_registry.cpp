@@ -0,0 +1,171 @@
+#include "authentication/user_registry.h"
+
+/// Get the registry for a filesystem root, creating it on first use
+/// \param filesystem_path    The filesystem root containing common/user_list
+UserRegistry& UserRegistry::Instance(const std::string& filesystem_path) {
+    static std::mutex instances_mutex;
+    static std::unordered_map<std::string, std::unique_ptr<UserRegistry>> instances;
+
+    fs::path root = fs::absolute(filesystem_path).lexically_normal();
+    if (root.filename().empty()) {
+        root = root.parent_path();
+    }
+
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    auto it = instances.find(root.string());
+    if (it == instances.end()) {
+        std::unique_ptr<UserRegistry> registry(new UserRegistry(root));
+        it = instances.emplace(root.string(), std::move(registry)).first;
+    }
+    return *it->second;
+}
+
+UserRegistry::UserRegistry(const fs::path& root_path)
+    : root_path_(root_path),
+      user_list_path_(root_path / "common" / "user_list") {}
+
+/// Read the whole user list; a missing list is an empty registry
+void UserRegistry::Load() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    LoadLocked();
+}
+
+// Caller holds mutex_ exclusively
+void UserRegistry::LoadLocked() {
+    users_.clear();
+    struct stat list_stat;
+    list_ino_ = stat(user_list_path_.c_str(), &list_stat) == 0 ? list_stat.st_ino : 0;
+    list_offset_ = 0;
+    list_examined_ = 0;
+    ReadFrom(0);
+    loaded_ = true;
+}
+
+/// Exact match against the registered user names
+bool UserRegistry::Contains(const std::string& user_name) {
+    auto lock = ReadLock();
+    return users_.count(user_name) != 0;
+}
+
+/// \return The user's 256-bit metadata key, or an empty vector if it can't be read
+std::vector<uint8_t> UserRegistry::GetKey(const std::string& user_name) {
+    {
+        std::lock_guard<std::mutex> lock(keys_mutex_);
+        auto it = keys_.find(user_name);
+        if (it != keys_.end()) {
+            return it->second;
+        }
+    }
+    // Read without the lock; two threads reading the same key store the same bytes
+    std::vector<uint8_t> key = readEncKeyFromMetadata(user_name, (root_path_ / "common").string() + "/");
+    if (!key.empty()) {
+        std::lock_guard<std::mutex> lock(keys_mutex_);
+        keys_.emplace(user_name, key);
+    }
+    return key;
+}
+
+/// Register a new user by appending one line to the user list
+void UserRegistry::Add(const std::string& user_name) {
+    Add(std::vector<std::string>{user_name});
+}
+
+/// Register several users with a single append
+void UserRegistry::Add(const std::vector<std::string>& user_names) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    RefreshLocked();
+    std::string lines;
+    for (const std::string& user_name : user_names) {
+        lines += user_name + "\n";
+    }
+    int fd = ::open(user_list_path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open user list");
+    }
+    ssize_t written = ::write(fd, lines.data(), lines.size());
+    ::close(fd);
+    if (written != static_cast<ssize_t>(lines.size())) {
+        throw std::runtime_error("Failed to append to user list");
+    }
+    // Picks up our lines together with anything other processes appended before it
+    RefreshLocked();
+}
+
+/// Pick up users appended by other processes; a replaced or truncated list is read again from scratch
+void UserRegistry::RefreshIfChanged() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    RefreshLocked();
+}
+
+/// Shared lock for a lookup, taken after catching up with other writers; the common case where nothing
+/// changed never blocks other lookups
+std::shared_lock<std::shared_mutex> UserRegistry::ReadLock() {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (!NeedsRefresh()) {
+            return lock;
+        }
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        RefreshLocked();
+    }
+    return std::shared_lock<std::shared_mutex>(mutex_);
+}
+
+// The same checks as RefreshLocked, without changing anything; caller holds mutex_
+bool UserRegistry::NeedsRefresh() {
+    if (!loaded_) {
+        return true;
+    }
+    struct stat list_stat;
+    if (stat(user_list_path_.c_str(), &list_stat) != 0) {
+        return false;
+    }
+    uint64_t size = list_stat.st_size;
+    return list_stat.st_ino != list_ino_ || size < list_offset_ || size > list_examined_;
+}
+
+// Caller holds mutex_ exclusively
+void UserRegistry::RefreshLocked() {
+    if (!loaded_) {
+        LoadLocked();
+        return;
+    }
+    struct stat list_stat;
+    if (stat(user_list_path_.c_str(), &list_stat) != 0) {
+        return;
+    }
+    uint64_t size = list_stat.st_size;
+    if (list_stat.st_ino != list_ino_ || size < list_offset_) {
+        LoadLocked();
+    } else if (size > list_examined_) {
+        ReadFrom(list_offset_);
+    }
+}
+
+// Add every complete line after `offset`; a line still being written is picked up next time.
+// Caller holds mutex_ exclusively
+void UserRegistry::ReadFrom(uint64_t offset) {
+    int fd = ::open(user_list_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    std::string buffer;
+    char chunk[64 * 1024];
+    ssize_t n;
+    while ((n = ::pread(fd, chunk, sizeof(chunk), offset + buffer.size())) > 0) {
+        buffer.append(chunk, n);
+    }
+    ::close(fd);
+
+    size_t position = 0, newline;
+    while ((newline = buffer.find('\n', position)) != std::string::npos) {
+        if (newline > position) {
+            users_.insert(buffer.substr(position, newline - position));
+        }
+        position = newline + 1;
+    }
+    list_offset_ = offset + position;
+    list_examined_ = offset + buffer.size();
+}
@@ -0,0 +1,67 @@
+/*
+* User Registry: Answers "does this user exist" and "what is their key" for the lifetime of the process.
+* common/user_list (one name per line, append-only) is read once into a hash set and afterwards only
+* its newly appended lines are read; keys from common/<user>_key are cached after their first read.
+* Lookups share a reader lock and only take it exclusively to catch up on new lines, like the metadata index.
+*/
+
+#ifndef USER_REGISTRY_H
+#define USER_REGISTRY_H
+
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "helpers/helper_functions.h"
+
+namespace fs = std::filesystem;
+
+class UserRegistry {
+public:
+    static UserRegistry& Instance(const std::string& filesystem_path);
+
+    void Load();
+    bool Contains(const std::string& user_name);
+    std::vector<uint8_t> GetKey(const std::string& user_name);
+    void Add(const std::string& user_name);
+    void Add(const std::vector<std::string>& user_names);
+    void RefreshIfChanged();
+
+private:
+    explicit UserRegistry(const fs::path& root_path);
+    std::shared_lock<std::shared_mutex> ReadLock();
+    bool NeedsRefresh();
+    void LoadLocked();
+    void RefreshLocked();
+    void ReadFrom(uint64_t offset);
+
+    fs::path root_path_;
+    std::string user_list_path_;
+
+    // Guards everything below except keys_; held shared by lookups and exclusively by refreshes and Add
+    std::shared_mutex mutex_;
+    std::unordered_set<std::string> users_;
+    bool loaded_ = false;
+
+    // user_list inode, the end of the last complete line read, and how much of it we have looked at: more
+    // than that while a line is still being written, which is only read again once the list grows
+    ino_t list_ino_ = 0;
+    uint64_t list_offset_ = 0;
+    uint64_t list_examined_ = 0;
+
+    // Keys never change once a user exists, so each is read from disk once
+    std::mutex keys_mutex_;
+    std::unordered_map<std::string, std::vector<uint8_t>> keys_;
+};
+
+#endif // USER_REGISTRY_H
@@ -0,0 +1,618 @@
+#include "encryption/encryption.h"
+
+void Encryption::handleErrors(const std::string& message) {
+    throw std::runtime_error(message);
+}
+
+/// \param iv          May be null when the IV is supplied per chunk with EVP_*Init_ex(ctx, nullptr, nullptr, nullptr, iv)
+/// \param ivLength    Length of the GCM IV in bytes
+Encryption::CipherContext::CipherContext(const std::vector<uint8_t>& key, const uint8_t* iv, bool encrypt, int ivLength)
+    : uncaughtExceptions_(std::uncaught_exceptions()) {
+    if (key.size() != KEY_SIZE) {
+        handleErrors("Invalid encryption key.");
+    }
+
+    std::vector<EVP_CIPHER_CTX*>& idle = idleContexts().contexts;
+    bool reused = !idle.empty();
+    if (reused) {
+        ctx_ = idle.back();
+        idle.pop_back();
+    } else {
+        ctx_ = EVP_CIPHER_CTX_new();
+        if (!ctx_) {
+            handleErrors("Cipher context initialization failed.");
+        }
+    }
+
+    // A pooled context keeps its cipher, so only the key schedule is redone.
+    // The IV length has to be set before the IV itself, otherwise OpenSSL 3 discards the IV
+    if ((!reused && 1 != EVP_CipherInit_ex(ctx_, cipher(), nullptr, nullptr, nullptr, encrypt ? 1 : 0)) ||
+        1 != EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_IVLEN, ivLength, nullptr) ||
+        1 != EVP_CipherInit_ex(ctx_, nullptr, nullptr, key.data(), iv, encrypt ? 1 : 0)) {
+        EVP_CIPHER_CTX_free(ctx_);
+        handleErrors(encrypt ? "Encryption initialization failed." : "Decryption initialization failed.");
+    }
+}
+
+Encryption::CipherContext::~CipherContext() {
+    std::vector<EVP_CIPHER_CTX*>& idle = idleContexts().contexts;
+    // A context abandoned halfway through by an exception isn't worth trusting again
+    if (std::uncaught_exceptions() > uncaughtExceptions_ || idle.size() >= CIPHER_CONTEXT_POOL_SIZE) {
+        EVP_CIPHER_CTX_free(ctx_);
+    } else {
+        idle.push_back(ctx_);
+    }
+}
+
+Encryption::CipherContext::IdleContexts::~IdleContexts() {
+    for (EVP_CIPHER_CTX* ctx : contexts) {
+        EVP_CIPHER_CTX_free(ctx);
+    }
+}
+
+Encryption::CipherContext::IdleContexts& Encryption::CipherContext::idleContexts() {
+    thread_local IdleContexts idle;
+    return idle;
+}
+
+/// Fetch the cipher and leave a context in this thread's pool, so processes forked afterwards start with both
+void Encryption::warmUp() {
+    std::vector<uint8_t> key(KEY_SIZE, 0);
+    CipherContext context(key, nullptr, true, NONCE_SIZE);
+}
+
+/// AES-256-GCM, looked up once instead of on every initialization
+const EVP_CIPHER* Encryption::CipherContext::cipher() {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static const EVP_CIPHER* gcm = EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr);
+#else
+    static const EVP_CIPHER* gcm = EVP_aes_256_gcm();
+#endif
+    if (!gcm) {
+        handleErrors("AES-256-GCM is not available.");
+    }
+    return gcm;
+}
+
+size_t Encryption::readFull(std::istream& input, unsigned char* buffer, size_t length) {
+    input.read(reinterpret_cast<char*>(buffer), length);
+    return input.gcount();
+}
+
+/// Peek at the magic without consuming it
+bool Encryption::isChunkedFile(std::istream& input) {
+    char magic[8];
+    std::streampos start = input.tellg();
+    input.read(magic, sizeof(magic));
+    bool isChunked = input.gcount() == sizeof(magic) && std::memcmp(magic, CHUNK_MAGIC, sizeof(magic)) == 0;
+    input.clear();
+    input.seekg(start);
+    return isChunked;
+}
+
+// AAD = header | little-endian chunk index | final flag
+void Encryption::buildChunkAad(uint8_t* aad, const uint8_t* header, uint64_t index, bool isFinal) {
+    std::memcpy(aad, header, CHUNK_HEADER_SIZE);
+    for (int i = 0; i < 8; ++i) {
+        aad[CHUNK_HEADER_SIZE + i] = static_cast<uint8_t>(index >> (8 * i));
+    }
+    aad[CHUNK_HEADER_SIZE + 8] = isFinal ? 1 : 0;
+}
+
+/// Encrypt one chunk under a fresh nonce into `record` as nonce | ciphertext | tag
+void Encryption::encryptChunk(EVP_CIPHER_CTX* ctx, const uint8_t* header, uint64_t index, bool isFinal,
+                              const unsigned char* plaintext, size_t length, std::vector<unsigned char>& record) {
+    record.resize(NONCE_SIZE + length + TAG_SIZE);
+    unsigned char* nonce = record.data();
+    unsigned char* ciphertext = nonce + NONCE_SIZE;
+    unsigned char* tag = ciphertext + length;
+
+    if (1 != RAND_bytes(nonce, NONCE_SIZE)) {
+        handleErrors("Failed to generate nonce.");
+    }
+    if (1 != EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce)) {
+        handleErrors("Encryption initialization failed.");
+    }
+
+    uint8_t aad[CHUNK_HEADER_SIZE + 9];
+    buildChunkAad(aad, header, index, isFinal);
+    int len = 0;
+    if (1 != EVP_EncryptUpdate(ctx, nullptr, &len, aad, sizeof(aad))) {
+        handleErrors("Encryption failed.");
+    }
+    if (length > 0 && 1 != EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, length)) {
+        handleErrors("Encryption failed.");
+    }
+    if (1 != EVP_EncryptFinal_ex(ctx, ciphertext + length, &len)) {
+        handleErrors("Final encryption step failed.");
+    }
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, tag)) {
+        handleErrors("Failed to get tag.");
+    }
+}
+
+/// Verify and decrypt one nonce | ciphertext | tag record
+/// \return Number of plaintext bytes written
+size_t Encryption::decryptChunk(EVP_CIPHER_CTX* ctx, const uint8_t* header, uint64_t index, bool isFinal,
+                                const unsigned char* record, size_t recordLength, unsigned char* plaintext) {
+    if (recordLength < NONCE_SIZE + TAG_SIZE) {
+        handleErrors("Encrypted file is truncated.");
+    }
+    size_t length = recordLength - NONCE_SIZE - TAG_SIZE;
+    const unsigned char* nonce = record;
+    const unsigned char* ciphertext = record + NONCE_SIZE;
+    unsigned char tag[TAG_SIZE];
+    std::memcpy(tag, ciphertext + length, TAG_SIZE);
+
+    if (1 != EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce)) {
+        handleErrors("Decryption initialization failed.");
+    }
+
+    uint8_t aad[CHUNK_HEADER_SIZE + 9];
+    buildChunkAad(aad, header, index, isFinal);
+    int len = 0;
+    if (1 != EVP_DecryptUpdate(ctx, nullptr, &len, aad, sizeof(aad))) {
+        handleErrors("Decryption failed.");
+    }
+    if (length > 0 && 1 != EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, length)) {
+        handleErrors("Decryption failed.");
+    }
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, tag)) {
+        handleErrors("Failed to set expected tag.");
+    }
+    if (1 != EVP_DecryptFinal_ex(ctx, plaintext + length, &len)) {
+        handleErrors("Tag verification failed.");
+    }
+    return length;
+}
+
+/// Read SECFS_CRYPTO_WORKERS once; the count is fixed for the life of the process so a pool handed out is never resized
+size_t Encryption::workerCount() {
+    static const size_t workers = []() -> size_t {
+        const char* configured = std::getenv("SECFS_CRYPTO_WORKERS");
+        if (configured && std::atoi(configured) > 0) {
+            return std::atoi(configured);
+        }
+        return std::max(1u, std::thread::hardware_concurrency());
+    }();
+    return workers;
+}
+
+/// Shared pool sized to workerCount(); rebuilt in a forked child, where the parent's threads are gone
+ThreadPool& Encryption::workerPool() {
+    static std::mutex poolMutex;
+    static ThreadPool* pool = nullptr;
+    static pid_t poolOwner = 0;
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (!pool || poolOwner != getpid()) {
+        // Never joined or deleted: the old threads belong to the parent, and exiting never has to join workers
+        pool = new ThreadPool(workerCount());
+        poolOwner = getpid();
+    }
+    return *pool;
+}
+
+/// Split chunks [0, count) into one contiguous range per worker and run `work` on each range with a context
+/// keyed for it; a single range runs on the caller's thread
+void Encryption::forEachChunkRange(size_t count, const std::vector<uint8_t>& key, bool encrypt,
+                                   const std::function<void(EVP_CIPHER_CTX* ctx, size_t begin, size_t end)>& work) {
+    size_t tasks = std::min(count, workerCount());
+    if (tasks <= 1) {
+        CipherContext ctx(key, nullptr, encrypt, NONCE_SIZE);
+        work(ctx, 0, count);
+        return;
+    }
+
+    workerPool().parallelFor(tasks, [&](size_t task) {
+        CipherContext ctx(key, nullptr, encrypt, NONCE_SIZE);
+        work(ctx, count * task / tasks, count * (task + 1) / tasks);
+    });
+}
+
+/// Encrypt everything readable from `input` into the chunked container, holding one batch of chunks at a time
+void Encryption::encryptStream(std::istream& input, std::ostream& output, const std::vector<uint8_t>& key) {
+    uint8_t header[CHUNK_HEADER_SIZE] = {};
+    std::memcpy(header, CHUNK_MAGIC, 8);
+    uint32_t chunkSize = CHUNK_SIZE;
+    std::memcpy(header + 8, &chunkSize, sizeof(chunkSize));
+    output.write(reinterpret_cast<char*>(header), CHUNK_HEADER_SIZE);
+
+    size_t batchSize = workerCount() > 1 ? workerCount() * CHUNKS_PER_WORKER : 1;
+    // The extra slot at the end holds the chunk read ahead, so the last chunk can be flagged as final
+    std::vector<std::vector<unsigned char>> plaintexts(batchSize + 1, std::vector<unsigned char>(CHUNK_SIZE));
+    std::vector<size_t> lengths(batchSize + 1);
+    std::vector<std::vector<unsigned char>> records(batchSize);
+
+    lengths[batchSize] = readFull(input, plaintexts[batchSize].data(), CHUNK_SIZE);
+    bool finished = false;
+    for (uint64_t firstIndex = 0; !finished; ) {
+        size_t count = 0;
+        while (count < batchSize && !finished) {
+            plaintexts[count].swap(plaintexts[batchSize]);
+            lengths[count] = lengths[batchSize];
+            lengths[batchSize] = lengths[count] == CHUNK_SIZE ? readFull(input, plaintexts[batchSize].data(), CHUNK_SIZE) : 0;
+            finished = lengths[batchSize] == 0;
+            ++count;
+        }
+
+        forEachChunkRange(count, key, true, [&](EVP_CIPHER_CTX* rangeCtx, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                encryptChunk(rangeCtx, header, firstIndex + i, finished && i == count - 1, plaintexts[i].data(), lengths[i], records[i]);
+            }
+        });
+
+        for (size_t i = 0; i < count; ++i) {
+            output.write(reinterpret_cast<char*>(records[i].data()), records[i].size());
+        }
+        if (!output) {
+            handleErrors("Failed to write encrypted data.");
+        }
+        firstIndex += count;
+    }
+}
+
+/// Decrypt a chunked container from `input`, writing a batch of chunks to `output` only after all their tags verify
+void Encryption::decryptStream(std::istream& input, std::ostream& output, const std::vector<uint8_t>& key) {
+    uint8_t header[CHUNK_HEADER_SIZE];
+    if (readFull(input, header, CHUNK_HEADER_SIZE) != CHUNK_HEADER_SIZE || std::memcmp(header, CHUNK_MAGIC, 8) != 0) {
+        handleErrors("Not an encrypted file.");
+    }
+    uint32_t chunkSize;
+    std::memcpy(&chunkSize, header + 8, sizeof(chunkSize));
+    if (chunkSize == 0 || chunkSize > MAX_CHUNK_SIZE) {
+        handleErrors("Invalid chunk size.");
+    }
+
+    size_t batchSize = workerCount() > 1 ? workerCount() * CHUNKS_PER_WORKER : 1;
+    size_t recordSize = NONCE_SIZE + chunkSize + TAG_SIZE;
+    std::vector<std::vector<unsigned char>> records(batchSize, std::vector<unsigned char>(recordSize));
+    std::vector<std::vector<unsigned char>> plaintexts(batchSize, std::vector<unsigned char>(chunkSize));
+    std::vector<size_t> recordLengths(batchSize), lengths(batchSize);
+
+    bool finished = false;
+    for (uint64_t firstIndex = 0; !finished; ) {
+        size_t count = 0;
+        while (count < batchSize && !finished) {
+            recordLengths[count] = readFull(input, records[count].data(), recordSize);
+            // A short record can only be the last one; a full one is last if nothing follows it
+            finished = recordLengths[count] < recordSize || input.peek() == std::char_traits<char>::eof();
+            ++count;
+        }
+
+        forEachChunkRange(count, key, false, [&](EVP_CIPHER_CTX* rangeCtx, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                lengths[i] = decryptChunk(rangeCtx, header, firstIndex + i, finished && i == count - 1,
+                                          records[i].data(), recordLengths[i], plaintexts[i].data());
+            }
+        });
+
+        for (size_t i = 0; i < count; ++i) {
+            output.write(reinterpret_cast<char*>(plaintexts[i].data()), lengths[i]);
+        }
+        firstIndex += count;
+    }
+}
+
+/// Work out chunk count and plaintext size of the container at the current position from its header and length alone
+void Encryption::readChunkLayout(std::istream& input, ChunkLayout& layout) {
+    layout.base = input.tellg();
+    input.seekg(0, std::ios::end);
+    uint64_t fileSize = input.tellg();
+    input.seekg(layout.base);
+    if (readFull(input, layout.header, CHUNK_HEADER_SIZE) != CHUNK_HEADER_SIZE || std::memcmp(layout.header, CHUNK_MAGIC, 8) != 0) {
+        handleErrors("Not an encrypted file.");
+    }
+    std::memcpy(&layout.chunkSize, layout.header + 8, sizeof(layout.chunkSize));
+    if (layout.chunkSize == 0 || layout.chunkSize > MAX_CHUNK_SIZE) {
+        handleErrors("Invalid chunk size.");
+    }
+
+    layout.recordSize = NONCE_SIZE + uint64_t(layout.chunkSize) + TAG_SIZE;
+    uint64_t bodySize = fileSize - layout.base - CHUNK_HEADER_SIZE;
+    layout.chunkCount = bodySize == 0 ? 1 : (bodySize + layout.recordSize - 1) / layout.recordSize;
+    uint64_t lastRecordSize = bodySize - (layout.chunkCount - 1) * layout.recordSize;
+    if (lastRecordSize < NONCE_SIZE + TAG_SIZE) {
+        handleErrors("Encrypted file is truncated.");
+    }
+    layout.plaintextSize = (layout.chunkCount - 1) * layout.chunkSize + (lastRecordSize - NONCE_SIZE - TAG_SIZE);
+}
+
+/// Seek to and decrypt a single chunk; only the last chunk of the file is expected to carry the final flag
+size_t Encryption::readChunk(std::istream& input, const ChunkLayout& layout, EVP_CIPHER_CTX* ctx, uint64_t index,
+                             std::vector<unsigned char>& record, unsigned char* plaintext) {
+    input.clear();
+    input.seekg(layout.base + CHUNK_HEADER_SIZE + index * layout.recordSize);
+    size_t recordLength = readFull(input, record.data(), layout.recordSize);
+    return decryptChunk(ctx, layout.header, index, index == layout.chunkCount - 1, record.data(), recordLength, plaintext);
+}
+
+/// Decrypt only the chunks overlapping [offset, offset + length) of a file
+/// \return The plaintext bytes in range; shorter than `length` if the file ends first
+std::string Encryption::readRange(const std::string& filePath, uint64_t offset, uint64_t length, const std::vector<uint8_t>& key) {
+    std::ifstream inputFile;
+    std::vector<uint8_t> dataKey;
+    if (!openForReading(filePath, key, inputFile, dataKey)) {
+        std::string content = decryptLegacy(inputFile, key);
+        return offset < content.size() ? content.substr(offset, length) : "";
+    }
+
+    ChunkLayout layout;
+    readChunkLayout(inputFile, layout);
+    if (offset >= layout.plaintextSize || length == 0) {
+        return "";
+    }
+    uint64_t end = offset + std::min(length, layout.plaintextSize - offset);
+
+    CipherContext ctx(dataKey, nullptr, false, NONCE_SIZE);
+
+    std::string result;
+    result.reserve(end - offset);
+    std::vector<unsigned char> record(layout.recordSize), plaintext(layout.chunkSize);
+    for (uint64_t index = offset / layout.chunkSize; index <= (end - 1) / layout.chunkSize; ++index) {
+        size_t chunkLength = readChunk(inputFile, layout, ctx, index, record, plaintext.data());
+        uint64_t chunkStart = index * layout.chunkSize;
+        uint64_t from = std::max(offset, chunkStart) - chunkStart;
+        uint64_t to = std::min<uint64_t>(end - chunkStart, chunkLength);
+        result.append(reinterpret_cast<char*>(plaintext.data()) + from, to - from);
+    }
+    return result;
+}
+
+/// Plaintext length of a file; chunked files don't need to be decrypted for this
+uint64_t Encryption::plaintextSize(const std::string& filePath, const std::vector<uint8_t>& key) {
+    std::ifstream inputFile;
+    std::vector<uint8_t> dataKey;
+    if (!openForReading(filePath, key, inputFile, dataKey)) {
+        return decryptLegacy(inputFile, key).size();
+    }
+    ChunkLayout layout;
+    readChunkLayout(inputFile, layout);
+    return layout.plaintextSize;
+}
+
+/// Write `content` as an envelope file; an existing file keeps its data key so stubs shared from it stay valid
+void Encryption::encryptFile(const std::string& filePath, const std::string& content, const std::vector<uint8_t>& key) {
+    std::vector<uint8_t> dataKey;
+    if (!readDataKey(filePath, key, dataKey)) {
+        dataKey.resize(KEY_SIZE);
+        if (1 != RAND_bytes(dataKey.data(), KEY_SIZE)) {
+            handleErrors("Failed to generate file key.");
+        }
+    }
+    unsigned char wrapped[WRAPPED_KEY_SIZE];
+    wrapKey(dataKey, key, ENVELOPE_MAGIC, wrapped);
+
+    // Written next to the file and renamed over it, so readers and concurrent writers of the same file
+    // only ever see a complete version
+    std::string temporaryPath = filePath + ".tmp." + std::to_string(::getpid()) + "." +
+                                std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    try {
+        std::ofstream outputFile(temporaryPath, std::ios::binary);
+        if (!outputFile.is_open()) {
+            handleErrors("Failed to open output file.");
+        }
+        outputFile.write(ENVELOPE_MAGIC, 8);
+        outputFile.write(reinterpret_cast<char*>(wrapped), WRAPPED_KEY_SIZE);
+
+        MemoryBuffer contentBuffer(content.data(), content.size());
+        std::istream input(&contentBuffer);
+        encryptStream(input, outputFile, dataKey);
+        outputFile.close();
+        if (!outputFile) {
+            handleErrors("Failed to write output file.");
+        }
+        if (std::rename(temporaryPath.c_str(), filePath.c_str()) != 0) {
+            handleErrors("Failed to replace output file.");
+        }
+    } catch (...) {
+        std::remove(temporaryPath.c_str());
+        throw;
+    }
+}
+
+/// Let another user read `filePath` by writing a stub at `stubPath` that holds the file's data key wrapped
+/// under `recipientKey`. Files from before envelope encryption are rewritten as envelope files first.
+void Encryption::grantAccess(const std::string& filePath, const std::vector<uint8_t>& ownerKey,
+                             const std::string& stubPath, const std::vector<uint8_t>& recipientKey) {
+    grantAccess(filePath, ownerKey, {AccessGrant{stubPath, recipientKey}});
+}
+
+/// Grant access to several users at once; the data key is unwrapped once and the stubs are written on the worker pool
+void Encryption::grantAccess(const std::string& filePath, const std::vector<uint8_t>& ownerKey, const std::vector<AccessGrant>& grants) {
+    std::vector<uint8_t> dataKey;
+    if (!readDataKey(filePath, ownerKey, dataKey)) {
+        encryptFile(filePath, decryptFile(filePath, ownerKey), ownerKey);
+        if (!readDataKey(filePath, ownerKey, dataKey)) {
+            handleErrors("Failed to unwrap file key.");
+        }
+    }
+
+    std::string absoluteFilePath = std::filesystem::absolute(filePath);
+    auto writeGrant = [&](size_t i) {
+        writeStub(grants[i].stubPath, absoluteFilePath, dataKey, grants[i].recipientKey);
+    };
+    if (workerCount() > 1 && grants.size() > 1) {
+        workerPool().parallelFor(grants.size(), writeGrant);
+    } else {
+        for (size_t i = 0; i < grants.size(); ++i) {
+            writeGrant(i);
+        }
+    }
+}
+
+void Encryption::writeStub(const std::string& stubPath, const std::string& absoluteFilePath,
+                           const std::vector<uint8_t>& dataKey, const std::vector<uint8_t>& recipientKey) {
+    std::string stubDirectory = std::filesystem::absolute(stubPath).parent_path();
+    std::string target = std::filesystem::relative(absoluteFilePath, stubDirectory);
+    unsigned char wrapped[WRAPPED_KEY_SIZE];
+    wrapKey(dataKey, recipientKey, STUB_MAGIC + target, wrapped);
+
+    std::ofstream stubFile(stubPath, std::ios::binary);
+    if (!stubFile.is_open()) {
+        handleErrors("Failed to open output file.");
+    }
+    stubFile.write(STUB_MAGIC, 8);
+    stubFile.write(reinterpret_cast<char*>(wrapped), WRAPPED_KEY_SIZE);
+    stubFile.write(target.data(), target.size());
+    stubFile.close();
+    if (!stubFile) {
+        handleErrors("Failed to write encrypted data.");
+    }
+}
+
+/// Whether `filePath` is a stub written by grantAccess rather than a full copy of a file
+bool Encryption::isAccessStub(const std::string& filePath) {
+    std::ifstream inputFile(filePath, std::ios::binary);
+    char magic[8];
+    inputFile.read(magic, sizeof(magic));
+    return inputFile.gcount() == sizeof(magic) && std::memcmp(magic, STUB_MAGIC, sizeof(magic)) == 0;
+}
+
+/// Wrap a data key as nonce | encrypted key | tag, authenticating `aad` along with it
+void Encryption::wrapKey(const std::vector<uint8_t>& dataKey, const std::vector<uint8_t>& key, const std::string& aad, unsigned char* wrapped) {
+    unsigned char* nonce = wrapped;
+    unsigned char* ciphertext = nonce + NONCE_SIZE;
+    unsigned char* tag = ciphertext + KEY_SIZE;
+    if (1 != RAND_bytes(nonce, NONCE_SIZE)) {
+        handleErrors("Failed to generate nonce.");
+    }
+
+    CipherContext ctx(key, nonce, true, NONCE_SIZE);
+    int len = 0;
+    if (1 != EVP_EncryptUpdate(ctx, nullptr, &len, reinterpret_cast<const unsigned char*>(aad.data()), aad.size()) ||
+        1 != EVP_EncryptUpdate(ctx, ciphertext, &len, dataKey.data(), KEY_SIZE) ||
+        1 != EVP_EncryptFinal_ex(ctx, ciphertext + KEY_SIZE, &len) ||
+        1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, tag)) {
+        handleErrors("Failed to wrap file key.");
+    }
+}
+
+/// \return false if the wrapped key doesn't verify under `key` and `aad`
+bool Encryption::unwrapKey(const unsigned char* wrapped, const std::vector<uint8_t>& key, const std::string& aad, std::vector<uint8_t>& dataKey) {
+    const unsigned char* nonce = wrapped;
+    const unsigned char* ciphertext = nonce + NONCE_SIZE;
+    unsigned char tag[TAG_SIZE];
+    std::memcpy(tag, ciphertext + KEY_SIZE, TAG_SIZE);
+
+    CipherContext ctx(key, nonce, false, NONCE_SIZE);
+    dataKey.resize(KEY_SIZE);
+    int len = 0;
+    if (1 != EVP_DecryptUpdate(ctx, nullptr, &len, reinterpret_cast<const unsigned char*>(aad.data()), aad.size()) ||
+        1 != EVP_DecryptUpdate(ctx, dataKey.data(), &len, ciphertext, KEY_SIZE) ||
+        1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, tag)) {
+        handleErrors("Failed to unwrap file key.");
+    }
+    return 1 == EVP_DecryptFinal_ex(ctx, dataKey.data() + KEY_SIZE, &len);
+}
+
+/// Data key of an envelope file owned by `key`
+/// \return false if the file is missing, isn't an envelope file or is wrapped under another key
+bool Encryption::readDataKey(const std::string& filePath, const std::vector<uint8_t>& key, std::vector<uint8_t>& dataKey) {
+    std::ifstream inputFile(filePath, std::ios::binary);
+    unsigned char envelope[8 + WRAPPED_KEY_SIZE];
+    if (readFull(inputFile, envelope, sizeof(envelope)) != sizeof(envelope) || std::memcmp(envelope, ENVELOPE_MAGIC, 8) != 0) {
+        return false;
+    }
+    return unwrapKey(envelope + 8, key, ENVELOPE_MAGIC, dataKey);
+}
+
+/// Open a file and position `input` at its content, following a stub to the file it points at
+/// \param dataKey    Set to the key the content is encrypted with
+/// \return           true for a chunked container, false for a legacy file
+bool Encryption::openForReading(const std::string& filePath, const std::vector<uint8_t>& key, std::ifstream& input, std::vector<uint8_t>& dataKey) {
+    input.open(filePath, std::ios::binary);
+    if (!input.is_open()) {
+        handleErrors("Failed to open input file.");
+    }
+
+    unsigned char envelope[8 + WRAPPED_KEY_SIZE];
+    size_t envelopeLength = readFull(input, envelope, sizeof(envelope));
+    if (envelopeLength == sizeof(envelope) && std::memcmp(envelope, ENVELOPE_MAGIC, 8) == 0) {
+        if (!unwrapKey(envelope + 8, key, ENVELOPE_MAGIC, dataKey)) {
+            handleErrors("Failed to unwrap file key.");
+        }
+        return true;
+    }
+
+    if (envelopeLength == sizeof(envelope) && std::memcmp(envelope, STUB_MAGIC, 8) == 0) {
+        std::string target((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        if (!unwrapKey(envelope + 8, key, STUB_MAGIC + target, dataKey)) {
+            handleErrors("Failed to unwrap file key.");
+        }
+        input.close();
+        input.clear();
+        input.open(std::filesystem::path(filePath).parent_path() / target, std::ios::binary);
+        if (!input.is_open()) {
+            handleErrors("Shared file no longer exists.");
+        }
+        // The stub carries its own wrapped copy of the data key; skip the owner's
+        if (readFull(input, envelope, sizeof(envelope)) != sizeof(envelope) || std::memcmp(envelope, ENVELOPE_MAGIC, 8) != 0) {
+            handleErrors("Shared file is not an encrypted file.");
+        }
+        return true;
+    }
+
+    input.clear();
+    input.seekg(0);
+    dataKey = key;
+    return isChunkedFile(input);
+}
+
+std::string Encryption::decryptFile(const std::string& filePath, const std::vector<uint8_t>& key) {
+    std::ostringstream output;
+    decryptFile(filePath, output, key);
+    return output.str();
+}
+
+/// Decrypt a file straight into `output`; chunked files never need more than one chunk in memory
+void Encryption::decryptFile(const std::string& filePath, std::ostream& output, const std::vector<uint8_t>& key) {
+    std::ifstream inputFile;
+    std::vector<uint8_t> dataKey;
+    if (openForReading(filePath, key, inputFile, dataKey)) {
+        decryptStream(inputFile, output, dataKey);
+    } else {
+        output << decryptLegacy(inputFile, key);
+    }
+}
+
+// Files written before the chunked container: IV | tag | ciphertext
+std::string Encryption::decryptLegacy(std::istream& inputFile, const std::vector<uint8_t>& key) {
+    uint8_t iv[IV_SIZE], tag[TAG_SIZE];
+    inputFile.read(reinterpret_cast<char*>(iv), IV_SIZE);
+    inputFile.read(reinterpret_cast<char*>(tag), TAG_SIZE);
+
+    // These were written with OpenSSL 1.1, which applied the IV before the 16 byte IV length was set,
+    // so only the first 12 bytes of the stored IV were ever used
+    CipherContext ctx(key, iv, false, NONCE_SIZE);
+
+    std::vector<unsigned char> buffer((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
+    std::vector<unsigned char> decryptedText(buffer.size());
+
+    int len = 0, plaintextLen = 0;
+    if (1 != EVP_DecryptUpdate(ctx, decryptedText.data(), &len, buffer.data(), buffer.size())) {
+        handleErrors("Decryption failed.");
+    }
+    plaintextLen += len;
+
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, tag)) {
+        handleErrors("Failed to set expected tag.");
+    }
+
+    if (1 != EVP_DecryptFinal_ex(ctx, decryptedText.data() + len, &len)) {
+        handleErrors("Tag verification failed.");
+    }
+    plaintextLen += len;
+
+    std::string ptOutput(decryptedText.begin(), decryptedText.begin() + plaintextLen);
+
+    // Legacy files carry the command's separator space in front and a block of zero padding behind
+    if (!ptOutput.empty() && ptOutput[0] == ' ') {
+        ptOutput.erase(0, 1);
+    }
+    if (ptOutput.size() >= BLOCK_SIZE && ptOutput.find_first_not_of('\0', ptOutput.size() - BLOCK_SIZE) == std::string::npos) {
+        ptOutput.erase(ptOutput.size() - BLOCK_SIZE);
+    }
+
+    return ptOutput;
+}
@@ -1,141 +1,159 @@
 /*
-* File Encryption/Decryption: Ensures that all files stored in the filesystem are encrypted 
+* File Encryption/Decryption: Ensures that all files stored in the filesystem are encrypted
 * and can only be decrypted by the middleware when accessed by an authenticated user.
+*
+* Files are written as a chunked AES-256-GCM container so they can be processed with constant memory:
+*   header    magic "EFSCHNK1" | uint32 chunk size | uint32 reserved
+*   chunks    { nonce (12) | ciphertext (<= chunk size) | tag (16) } ...
+* Every chunk authenticates the header, its own index and whether it is the last chunk, so chunks
+* can't be reordered, dropped or truncated away. Because chunks have a fixed size, a byte range
+* maps to the chunks that hold it and can be read without touching the rest of the file.
+* Files from before the container format (IV | tag | ciphertext as one GCM stream) are still readable.
+*
+* Files are written with envelope encryption: the container is encrypted under a random per-file data key,
+* and the data key is stored wrapped (AES-256-GCM) under the key of every user who may read the file:
+*   file      magic "EFSENV01" | wrapped data key (nonce | key | tag) | container
+*   stub      magic "EFSSTUB1" | wrapped data key | path of the file relative to the stub's directory
+* Sharing writes a stub for the recipient and overwriting a file keeps its data key, so neither has to
+* re-encrypt the contents for anybody else.
+*
+* Chunks are independent, so streams are processed in batches that are spread over a worker pool and
+* written back in order. SECFS_CRYPTO_WORKERS sets the worker count (default: one per core, 1 = serial).
+*
+* Cipher contexts are kept in a small per-thread pool and only re-keyed between files. Errors are
+* reported by throwing std::runtime_error, which hands any context in use back on the way out.
 */
 
 #ifndef FILESERVER_ENCRYPTION_H
 #define FILESERVER_ENCRYPTION_H
 
+#include "helpers/thread_pool.h"
 #include <openssl/conf.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/opensslv.h>
 #include <openssl/rand.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 #define BLOCK_SIZE 16 //bytes
 #define KEY_SIZE 32 //bytes
 #define TAG_SIZE 16 //bytes
 #define IV_SIZE 16 //bytes
+#define NONCE_SIZE 12 //bytes
+#define CHUNK_SIZE 65536 //bytes
+#define MAX_CHUNK_SIZE (16 * 1024 * 1024) //bytes
+#define CHUNK_MAGIC "EFSCHNK1"
+#define CHUNK_HEADER_SIZE 16 //bytes
+#define CHUNKS_PER_WORKER 4 // chunks each worker handles per batch
+#define CIPHER_CONTEXT_POOL_SIZE 4 // idle contexts kept per thread
+#define ENVELOPE_MAGIC "EFSENV01"
+#define STUB_MAGIC "EFSSTUB1"
+#define WRAPPED_KEY_SIZE (NONCE_SIZE + KEY_SIZE + TAG_SIZE) //bytes
+
+// A user to give read access to a file: where their stub goes and the key it is wrapped with
+struct AccessGrant {
+    std::string stubPath;
+    std::vector<uint8_t> recipientKey;
+};
 
 class Encryption {
 public:
     static void encryptFile(const std::string& filePath, const std::string& content, const std::vector<uint8_t>& key);
     static std::string decryptFile(const std::string& filePath, const std::vector<uint8_t>& key);
+    static void decryptFile(const std::string& filePath, std::ostream& output, const std::vector<uint8_t>& key);
 
-private:
-    static void handleErrors(const std::string& message);
-    static void initCipherContext(EVP_CIPHER_CTX*& ctx, const std::vector<uint8_t>& key, const uint8_t* iv, bool encrypt);
-};
-
-void Encryption::handleErrors(const std::string& message) {
-    std::cerr << message << std::endl;
-    exit(EXIT_FAILURE); // It's more conventional to exit with a failure status on error.
-}
-
-void Encryption::initCipherContext(EVP_CIPHER_CTX*& ctx, const std::vector<uint8_t>& key, const uint8_t* iv, bool encrypt) {
-    ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        handleErrors("Cipher context initialization failed.");
-    }
-
-    if (encrypt) {
-        if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key.data(), iv)) {
-            handleErrors("Encryption initialization failed.");
-        }
-    } else {
-        if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key.data(), iv)) {
-            handleErrors("Decryption initialization failed.");
-        }
-    }
-
-    if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, IV_SIZE, nullptr)) {
-        handleErrors("Failed to set IV length.");
-    }
-}
-
-void Encryption::encryptFile(const std::string& filePath, const std::string& content, const std::vector<uint8_t>& key) {
-    uint8_t iv[IV_SIZE];
-    RAND_bytes(iv, sizeof(iv));
-    unsigned char tag[TAG_SIZE];
-    EVP_CIPHER_CTX* ctx;
-
-    initCipherContext(ctx, key, iv, true);
-
-    std::ofstream outputFile(filePath, std::ios::binary);
-    if (!outputFile.is_open()) {
-        handleErrors("Failed to open output file.");
-    }
-
-    std::vector<unsigned char> buffer(content.begin(), content.end());
-    buffer.resize(buffer.size() + BLOCK_SIZE); // Ensure space for padding
-    int len = 0, ciphertextLen = 0;
-
-    if (1 != EVP_EncryptUpdate(ctx, buffer.data(), &len, buffer.data(), buffer.size())) {
-        handleErrors("Encryption failed.");
-    }
-    ciphertextLen += len;
-
-    if (1 != EVP_EncryptFinal_ex(ctx, buffer.data() + len, &len)) {
-        handleErrors("Final encryption step failed.");
-    }
-    ciphertextLen += len;
-
-    if (1 != EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, tag)) {
-        handleErrors("Failed to get tag.");
-    }
-
-    outputFile.write(reinterpret_cast<char*>(iv), IV_SIZE);
-    outputFile.write(reinterpret_cast<char*>(tag), TAG_SIZE);
-    outputFile.write(reinterpret_cast<char*>(buffer.data()), ciphertextLen);
-
-    EVP_CIPHER_CTX_free(ctx);
-    outputFile.close();
-}
-
-std::string Encryption::decryptFile(const std::string& filePath, const std::vector<uint8_t>& key) {
-    std::ifstream inputFile(filePath, std::ios::binary);
-    if (!inputFile.is_open()) {
-        handleErrors("Failed to open input file.");
-    }
-
-    uint8_t iv[IV_SIZE], tag[TAG_SIZE];
-    inputFile.read(reinterpret_cast<char*>(iv), IV_SIZE);
-    inputFile.read(reinterpret_cast<char*>(tag), TAG_SIZE);
-
-    EVP_CIPHER_CTX* ctx;
-    initCipherContext(ctx, key, iv, false);
+    static void encryptStream(std::istream& input, std::ostream& output, const std::vector<uint8_t>& key);
+    static void decryptStream(std::istream& input, std::ostream& output, const std::vector<uint8_t>& key);
 
-    std::vector<unsigned char> buffer((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
-    std::vector<unsigned char> decryptedText(buffer.size());
+    static std::string readRange(const std::string& filePath, uint64_t offset, uint64_t length, const std::vector<uint8_t>& key);
+    static uint64_t plaintextSize(const std::string& filePath, const std::vector<uint8_t>& key);
 
-    int len = 0, plaintextLen = 0;
-    if (1 != EVP_DecryptUpdate(ctx, decryptedText.data(), &len, buffer.data(), buffer.size())) {
-        handleErrors("Decryption failed.");
-    }
-    plaintextLen += len;
+    static void grantAccess(const std::string& filePath, const std::vector<uint8_t>& ownerKey,
+                            const std::string& stubPath, const std::vector<uint8_t>& recipientKey);
+    static void grantAccess(const std::string& filePath, const std::vector<uint8_t>& ownerKey, const std::vector<AccessGrant>& grants);
+    static bool isAccessStub(const std::string& filePath);
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, tag)) {
-        handleErrors("Failed to set expected tag.");
-    }
+    static size_t workerCount();
+    static ThreadPool& workerPool();
+    static void warmUp();
 
-    if (1 != EVP_DecryptFinal_ex(ctx, decryptedText.data() + len, &len)) {
-        handleErrors("Tag verification failed.");
-    }
-    plaintextLen += len;
-
-    EVP_CIPHER_CTX_free(ctx);
+private:
+    // A pooled EVP_CIPHER_CTX keyed for one use; it goes back to its thread's pool instead of being freed
+    class CipherContext {
+    public:
+        CipherContext(const std::vector<uint8_t>& key, const uint8_t* iv, bool encrypt, int ivLength);
+        ~CipherContext();
+        CipherContext(const CipherContext&) = delete;
+        CipherContext& operator=(const CipherContext&) = delete;
+
+        operator EVP_CIPHER_CTX*() const { return ctx_; }
+
+    private:
+        struct IdleContexts {
+            std::vector<EVP_CIPHER_CTX*> contexts;
+            ~IdleContexts();
+        };
+
+        static IdleContexts& idleContexts();
+        static const EVP_CIPHER* cipher();
+
+        EVP_CIPHER_CTX* ctx_ = nullptr;
+        int uncaughtExceptions_;
+    };
+
+    struct ChunkLayout {
+        uint64_t base;
+        uint8_t header[CHUNK_HEADER_SIZE];
+        uint32_t chunkSize;
+        uint64_t recordSize;
+        uint64_t chunkCount;
+        uint64_t plaintextSize;
+    };
+
+    [[noreturn]] static void handleErrors(const std::string& message);
+    static bool isChunkedFile(std::istream& input);
+    static void buildChunkAad(uint8_t* aad, const uint8_t* header, uint64_t index, bool isFinal);
+    static void encryptChunk(EVP_CIPHER_CTX* ctx, const uint8_t* header, uint64_t index, bool isFinal,
+                             const unsigned char* plaintext, size_t length, std::vector<unsigned char>& record);
+    static size_t decryptChunk(EVP_CIPHER_CTX* ctx, const uint8_t* header, uint64_t index, bool isFinal,
+                               const unsigned char* record, size_t recordLength, unsigned char* plaintext);
+    static std::string decryptLegacy(std::istream& inputFile, const std::vector<uint8_t>& key);
+    static void wrapKey(const std::vector<uint8_t>& dataKey, const std::vector<uint8_t>& key, const std::string& aad, unsigned char* wrapped);
+    static bool unwrapKey(const unsigned char* wrapped, const std::vector<uint8_t>& key, const std::string& aad, std::vector<uint8_t>& dataKey);
+    static void writeStub(const std::string& stubPath, const std::string& absoluteFilePath,
+                          const std::vector<uint8_t>& dataKey, const std::vector<uint8_t>& recipientKey);
+    static bool readDataKey(const std::string& filePath, const std::vector<uint8_t>& key, std::vector<uint8_t>& dataKey);
+    static bool openForReading(const std::string& filePath, const std::vector<uint8_t>& key, std::ifstream& input, std::vector<uint8_t>& dataKey);
+    static void readChunkLayout(std::istream& input, ChunkLayout& layout);
+    static size_t readChunk(std::istream& input, const ChunkLayout& layout, EVP_CIPHER_CTX* ctx, uint64_t index,
+                            std::vector<unsigned char>& record, unsigned char* plaintext);
+    static size_t readFull(std::istream& input, unsigned char* buffer, size_t length);
+    static void forEachChunkRange(size_t count, const std::vector<uint8_t>& key, bool encrypt,
+                                  const std::function<void(EVP_CIPHER_CTX* ctx, size_t begin, size_t end)>& work);
+};
 
-    std::string ptOutput(decryptedText.begin(), decryptedText.begin() + plaintextLen);
-    
-    // Fix: Delete first character if it's a space
-    if (!ptOutput.empty() && ptOutput[0] == ' ') {
-        ptOutput.erase(0, 1);
+// Read-only streambuf over existing memory, so encrypting a string doesn't copy it into a stringstream
+class MemoryBuffer : public std::streambuf {
+public:
+    MemoryBuffer(const char* data, size_t length) {
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + length);
     }
-
-    return ptOutput;
-}
+};
 
 #endif // FILESERVER_ENCRYPTION_H
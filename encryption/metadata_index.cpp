@@ -0,0 +1,629 @@
+#include "encryption/metadata_index.h"
+
+#include <algorithm>
+
+#include "helpers/json.hpp"
+
+/// Get the index for a filesystem root, creating it on first use
+/// \param path_to_metadata    The filesystem root containing the common/ metadata directory
+MetadataIndex& MetadataIndex::Instance(const std::string& path_to_metadata) {
+    static std::mutex instances_mutex;
+    static std::unordered_map<std::string, std::unique_ptr<MetadataIndex>> instances;
+
+    // "/root" and "/root/" must share one index
+    fs::path root = fs::absolute(path_to_metadata).lexically_normal();
+    if (root.filename().empty()) {
+        root = root.parent_path();
+    }
+
+    std::lock_guard<std::mutex> lock(instances_mutex);
+    auto it = instances.find(root.string());
+    if (it == instances.end()) {
+        std::unique_ptr<MetadataIndex> index(new MetadataIndex(root / "common"));
+        it = instances.emplace(root.string(), std::move(index)).first;
+    }
+    return *it->second;
+}
+
+MetadataIndex::MetadataIndex(const fs::path& metadata_directory)
+    : root_path_(metadata_directory.parent_path()),
+      legacy_snapshot_path_(metadata_directory / "structure.json"),
+      snapshot_path_(metadata_directory / "structure.bin"),
+      journal_path_(metadata_directory / "structure.journal"),
+      compacting_path_(metadata_directory / "structure.journal.compacting"),
+      lock_path_(metadata_directory / "structure.lock") {}
+
+MetadataIndex::~MetadataIndex() {
+    if (compaction_thread_.joinable()) {
+        compaction_thread_.join();
+    }
+}
+
+/// Map the snapshot and rebuild the maps from journal records not yet compacted into it
+void MetadataIndex::Load() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    LoadLocked();
+}
+
+void MetadataIndex::LoadLocked() {
+    // Converting rewrites structure.bin, which only a holder of the metadata lock may do. Taken before
+    // snapshot_mutex_, the order the compaction swap uses
+    std::optional<MetadataLock> file_lock;
+    if (!file_locked_ && SnapshotNeedsConversion()) {
+        file_lock.emplace(lock_path_);
+    }
+    bool may_convert = file_locked_ || file_lock;
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+
+    // Trees created before the binary store only have structure.json. Checked again under the lock,
+    // another process may have migrated it while we waited
+    if (may_convert && !fs::exists(snapshot_path_) && fs::exists(legacy_snapshot_path_)) {
+        MetadataStore::MigrateFromJson(legacy_snapshot_path_, snapshot_path_);
+    }
+
+    // Stat before mapping: if the snapshot is replaced meanwhile the next refresh sees a mismatch
+    if (stat(snapshot_path_.c_str(), &snapshot_stat_) != 0 || !snapshot_.Open(snapshot_path_)) {
+        throw std::runtime_error("Failed to open structure.bin file");
+    }
+    if (snapshot_.Version() < METADATA_STORE_VERSION) {
+        if (!may_convert) {
+            throw std::runtime_error("structure.bin was replaced by an older version while loading");
+        }
+        UpgradeSnapshot();
+    }
+
+    randomized_to_plaintext_.clear();
+    plaintext_to_randomized_.clear();
+    children_.clear();
+
+    auto index = [this](const std::string& key, const std::string& value) { Index(key, value); };
+    MetadataJournal::Replay(compacting_path_, 0, index);
+
+    struct stat journal_stat;
+    journal_ino_ = stat(journal_path_.c_str(), &journal_stat) == 0 ? journal_stat.st_ino : 0;
+    journal_records_ = 0;
+    journal_offset_ = MetadataJournal::Replay(journal_path_, 0, index, &journal_records_, &journal_examined_);
+
+    loaded_ = true;
+}
+
+/// \return Whether structure.bin has yet to be migrated from structure.json or rewritten from an older version
+bool MetadataIndex::SnapshotNeedsConversion() const {
+    if (!fs::exists(snapshot_path_)) {
+        return fs::exists(legacy_snapshot_path_);
+    }
+    MetadataStore store;
+    try {
+        return store.Open(snapshot_path_) && store.Version() < METADATA_STORE_VERSION;
+    } catch (const std::exception&) {
+        // Reported by the load itself
+        return false;
+    }
+}
+
+bool MetadataIndex::Contains(const std::string& randomized_name) {
+    auto lock = ReadLock();
+    return ContainsLocked(randomized_name);
+}
+
+bool MetadataIndex::ContainsLocked(const std::string& randomized_name) {
+    std::string plaintext;
+    return randomized_to_plaintext_.count(randomized_name) != 0 || snapshot_.Find(randomized_name, plaintext);
+}
+
+/// \return The stored plaintext path for a randomized name, or "" if unknown
+std::string MetadataIndex::GetPlaintext(const std::string& randomized_name) {
+    auto lock = ReadLock();
+    auto it = randomized_to_plaintext_.find(randomized_name);
+    if (it != randomized_to_plaintext_.end()) {
+        return it->second;
+    }
+    std::string plaintext;
+    snapshot_.Find(randomized_name, plaintext);
+    return plaintext;
+}
+
+/// \return The randomized name registered for a plaintext path, or "" if unknown
+std::string MetadataIndex::GetRandomized(const std::string& plaintext) {
+    auto lock = ReadLock();
+    return FindRandomized(plaintext);
+}
+
+/// Resolve many plaintext paths against a single refresh of the snapshot and journal
+/// \return The randomized names in the same order, "" for unknown paths
+std::vector<std::string> MetadataIndex::GetRandomized(const std::vector<std::string>& plaintexts) {
+    auto lock = ReadLock();
+    std::vector<std::string> randomized_names;
+    randomized_names.reserve(plaintexts.size());
+    for (const std::string& plaintext : plaintexts) {
+        randomized_names.push_back(FindRandomized(plaintext));
+    }
+    return randomized_names;
+}
+
+std::string MetadataIndex::FindRandomized(const std::string& plaintext) {
+    std::string randomized_name;
+    if (snapshot_.FindKey(plaintext, randomized_name) && IsRemapped(randomized_name)) {
+        randomized_name.clear();
+    }
+
+    // Smallest key wins on duplicates, matching the old ordered scan over the JSON object
+    auto it = plaintext_to_randomized_.find(plaintext);
+    if (it != plaintext_to_randomized_.end() && (randomized_name.empty() || it->second < randomized_name)) {
+        return it->second;
+    }
+    return randomized_name;
+}
+
+/// \return Whether a journal record maps a snapshot key to a different plaintext than the snapshot does
+bool MetadataIndex::IsRemapped(const std::string& randomized_name) const {
+    auto it = randomized_to_plaintext_.find(randomized_name);
+    if (it == randomized_to_plaintext_.end()) {
+        return false;
+    }
+    std::string stored;
+    return snapshot_.Find(randomized_name, stored) && stored != it->second;
+}
+
+/// Register a new mapping by appending one journal record; cost doesn't depend on the number of entries
+void MetadataIndex::Insert(const std::string& randomized_name, const std::string& plaintext) {
+    Insert({{randomized_name, plaintext}});
+}
+
+/// Register several (randomized name, plaintext) mappings with one journal write
+void MetadataIndex::Insert(const std::vector<std::pair<std::string, std::string>>& mappings) {
+    WriteLock lock(*this);
+    RefreshLocked();
+    AppendLocked(mappings);
+}
+
+/// Register a plaintext path under a freshly generated randomized name; the name is checked for
+/// collisions and inserted while holding the metadata lock, so no other writer can claim it in between
+/// \param generate_name    Called until it returns a name that isn't registered yet
+/// \return                 The registered randomized name
+std::string MetadataIndex::InsertNew(const std::string& plaintext, const NameGenerator& generate_name) {
+    return InsertGenerated(plaintext, generate_name, false);
+}
+
+/// Like InsertNew, but if the plaintext path is registered already, e.g. by a concurrent session creating
+/// the same file, its existing randomized name is returned instead of adding a second one
+std::string MetadataIndex::GetOrInsert(const std::string& plaintext, const NameGenerator& generate_name) {
+    return InsertGenerated(plaintext, generate_name, true);
+}
+
+std::string MetadataIndex::InsertGenerated(const std::string& plaintext, const NameGenerator& generate_name, bool reuse_existing) {
+    WriteLock lock(*this);
+    RefreshLocked();
+    if (reuse_existing) {
+        std::string existing = FindRandomized(plaintext);
+        if (!existing.empty()) {
+            return existing;
+        }
+    }
+    std::string randomized_name;
+    do {
+        randomized_name = generate_name();
+    } while (ContainsLocked(randomized_name));
+    AppendLocked({{randomized_name, plaintext}});
+    return randomized_name;
+}
+
+/// Register nested paths the way mkdir -p creates them: names[0] under parent, names[1] under the randomized
+/// name of names[0] and so on. Components registered already keep their names; all new ones go into the
+/// journal with one write, under one metadata lock
+/// \param parent    Randomized parent path as stored in metadata, e.g. "/filesystem/<user>/<personal>"
+/// \return          The randomized name of each component
+std::vector<std::string> MetadataIndex::GetOrInsertChain(const std::string& parent, const std::vector<std::string>& names,
+                                                         const NameGenerator& generate_name) {
+    return GetOrInsertChains({{parent, names}}, generate_name).front();
+}
+
+/// GetOrInsertChain for many chains with one journal write. Chains may share leading components, e.g.
+/// {user, "personal"} and {user, "shared"} below "/filesystem"; a component new to this batch gets one name
+/// \param chains    (randomized parent path, plaintext names) pairs
+/// \return          The randomized names of each chain's components, in the order of the chains
+std::vector<std::vector<std::string>> MetadataIndex::GetOrInsertChains(const std::vector<Chain>& chains,
+                                                                       const NameGenerator& generate_name) {
+    WriteLock lock(*this);
+    RefreshLocked();
+
+    std::vector<std::vector<std::string>> randomized_chains;
+    randomized_chains.reserve(chains.size());
+    std::vector<std::pair<std::string, std::string>> mappings;
+    // Plaintext paths registered by this batch, not in the index until the append below
+    std::unordered_map<std::string, std::string> pending;
+    std::unordered_set<std::string> taken;
+    for (const auto& [parent, names] : chains) {
+        std::vector<std::string> randomized_names;
+        std::string path = parent;
+        bool below_new = false;
+        for (const std::string& name : names) {
+            std::string plaintext = path + "/" + name;
+            std::string randomized_name;
+            auto it = pending.find(plaintext);
+            if (it != pending.end()) {
+                randomized_name = it->second;
+                below_new = true;
+            } else if (!below_new) {
+                // Below a new component nothing can be registered yet
+                randomized_name = FindRandomized(plaintext);
+            }
+            if (randomized_name.empty()) {
+                do {
+                    randomized_name = generate_name();
+                } while (ContainsLocked(randomized_name) || !taken.insert(randomized_name).second);
+                mappings.emplace_back(randomized_name, plaintext);
+                pending.emplace(plaintext, randomized_name);
+                below_new = true;
+            }
+            randomized_names.push_back(randomized_name);
+            path += "/" + randomized_name;
+        }
+        randomized_chains.push_back(std::move(randomized_names));
+    }
+    if (!mappings.empty()) {
+        AppendLocked(mappings);
+    }
+    return randomized_chains;
+}
+
+// Caller holds the metadata lock and mutex_ exclusively, and has refreshed since taking them
+void MetadataIndex::AppendLocked(const std::vector<std::pair<std::string, std::string>>& mappings) {
+    // Bytes after the last complete record can't be an append in progress while we hold the metadata lock,
+    // they are a record torn by a writer that died; our record must not land behind them
+    if (journal_ino_ != 0 && journal_examined_ > journal_offset_) {
+        MetadataJournal::TruncateTail(journal_path_, journal_offset_);
+        journal_examined_ = journal_offset_;
+    }
+    MetadataJournal::Append(journal_path_, mappings);
+    // Picks up our record together with anything other processes appended before it
+    RefreshLocked();
+
+    if (journal_records_ >= JOURNAL_COMPACTION_THRESHOLD) {
+        StartCompaction();
+    }
+}
+
+/// Entries registered directly under a stored parent path, with their on-disk type
+/// \param parent    Randomized parent path as stored in metadata, e.g. "/filesystem/<user>/<personal>"
+std::vector<ChildEntry> MetadataIndex::GetChildren(const std::string& parent) {
+    auto lock = ReadLock();
+    std::vector<ChildEntry> children;
+    snapshot_.ForEachChild(parent, [this, &children](std::string_view key, std::string_view name) {
+        // A journal record that remapped the key lists it under its new parent instead
+        if (!IsRemapped(std::string(key))) {
+            children.push_back({std::string(key), std::string(name), EntryType::Unknown});
+        }
+    });
+
+    auto delta = children_.find(parent);
+    if (delta != children_.end()) {
+        for (const auto& [key, name] : delta->second) {
+            // A record can be in both while a compaction is being picked up
+            std::string stored;
+            if (!snapshot_.Find(key, stored) || IsRemapped(key)) {
+                children.push_back({key, name, EntryType::Unknown});
+            }
+        }
+    }
+
+    for (ChildEntry& child : children) {
+        child.type = ResolveType(parent, child.randomized_name);
+    }
+    return children;
+}
+
+json MetadataIndex::ToJson() {
+    auto lock = ReadLock();
+    json metadata_json = json::object();
+    snapshot_.ForEach([&metadata_json](std::string_view key, std::string_view value) {
+        metadata_json[std::string(key)] = value;
+    });
+    for (const auto& [key, value] : randomized_to_plaintext_) {
+        metadata_json[key] = value;
+    }
+    return metadata_json;
+}
+
+/// Catch up with changes made by other processes: a replaced snapshot forces a reload,
+/// new journal records are replayed incrementally
+void MetadataIndex::RefreshIfChanged() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    RefreshLocked();
+}
+
+/// Shared lock for a lookup, taken after catching up with other writers; the common case where nothing
+/// changed never blocks other lookups
+std::shared_lock<std::shared_mutex> MetadataIndex::ReadLock() {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (!NeedsRefresh()) {
+            return lock;
+        }
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        RefreshLocked();
+    }
+    // Whatever was appended since is picked up by the next lookup
+    return std::shared_lock<std::shared_mutex>(mutex_);
+}
+
+// The same checks as RefreshLocked, without changing anything; caller holds mutex_
+bool MetadataIndex::NeedsRefresh() {
+    if (!loaded_ || SnapshotChanged()) {
+        return true;
+    }
+    struct stat journal_stat;
+    if (stat(journal_path_.c_str(), &journal_stat) != 0) {
+        return journal_ino_ != 0;
+    }
+    return journal_stat.st_ino != journal_ino_ || static_cast<uint64_t>(journal_stat.st_size) > journal_examined_;
+}
+
+// Caller holds mutex_ exclusively
+void MetadataIndex::RefreshLocked() {
+    if (!loaded_ || SnapshotChanged()) {
+        LoadLocked();
+        return;
+    }
+
+    struct stat journal_stat;
+    if (stat(journal_path_.c_str(), &journal_stat) != 0) {
+        if (journal_ino_ != 0) {
+            ReplayRotatedJournal();
+        }
+        return;
+    }
+    if (journal_stat.st_ino != journal_ino_) {
+        if (journal_ino_ != 0) {
+            ReplayRotatedJournal();
+        }
+        journal_ino_ = journal_stat.st_ino;
+        journal_offset_ = 0;
+        journal_examined_ = 0;
+        journal_records_ = 0;
+    }
+    if (static_cast<uint64_t>(journal_stat.st_size) > journal_examined_) {
+        ReplayJournalTail();
+    }
+}
+
+bool MetadataIndex::SnapshotChanged() {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    struct stat current;
+    if (stat(snapshot_path_.c_str(), &current) != 0) {
+        return false;
+    }
+    return current.st_ino != snapshot_stat_.st_ino ||
+           current.st_size != snapshot_stat_.st_size ||
+           current.st_mtim.tv_sec != snapshot_stat_.st_mtim.tv_sec ||
+           current.st_mtim.tv_nsec != snapshot_stat_.st_mtim.tv_nsec;
+}
+
+void MetadataIndex::ReplayJournalTail() {
+    journal_offset_ = MetadataJournal::Replay(journal_path_, journal_offset_,
+        [this](const std::string& key, const std::string& value) { Index(key, value); },
+        &journal_records_, &journal_examined_);
+}
+
+/// The journal we were following was moved aside for compaction; finish reading it from there
+void MetadataIndex::ReplayRotatedJournal() {
+    struct stat compacting_stat;
+    if (stat(compacting_path_.c_str(), &compacting_stat) != 0 || compacting_stat.st_ino != journal_ino_) {
+        // Already folded into a new snapshot by someone else; records past our offset only live there
+        LoadLocked();
+        return;
+    }
+    MetadataJournal::Replay(compacting_path_, journal_offset_,
+        [this](const std::string& key, const std::string& value) { Index(key, value); });
+    journal_ino_ = 0;
+    journal_offset_ = 0;
+    journal_examined_ = 0;
+    journal_records_ = 0;
+}
+
+/// Move the journal aside and fold it into the snapshot on a background thread.
+/// Caller holds the metadata lock, so no other process appends to the journal while it is moved
+void MetadataIndex::StartCompaction() {
+    if (compacting_) {
+        return;
+    }
+    if (compaction_thread_.joinable()) {
+        compaction_thread_.join();
+    }
+
+    if (link(journal_path_.c_str(), compacting_path_.c_str()) != 0) {
+        if (errno != EEXIST) {
+            std::cerr << "Metadata compaction failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        // A rotated journal is still pending: another process is folding it, or a compaction died before
+        // finishing. Fold it here under the lock we hold; the swap is skipped if the other process wins
+        struct stat rotated_stat;
+        if (stat(compacting_path_.c_str(), &rotated_stat) == 0 && rotated_stat.st_ino == damaged_rotated_ino_) {
+            // Reported already; folding it again on every append would only fail again
+            return;
+        }
+        std::string temporary_path = CompactionTemporaryPath();
+        try {
+            if (WriteCompactedSnapshot(temporary_path, rotated_stat)) {
+                SwapCompactedSnapshotLocked(temporary_path, rotated_stat);
+            }
+        } catch (const std::exception& e) {
+            unlink(temporary_path.c_str());
+            damaged_rotated_ino_ = rotated_stat.st_ino;
+            std::cerr << "Metadata compaction failed: leftover " << compacting_path_ << ": " << e.what() << std::endl;
+            return;
+        }
+        if (link(journal_path_.c_str(), compacting_path_.c_str()) != 0) {
+            std::cerr << "Metadata compaction failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+    }
+    unlink(journal_path_.c_str());
+    ReplayRotatedJournal();
+
+    compacting_ = true;
+    compaction_thread_ = std::thread(&MetadataIndex::Compact, this);
+}
+
+void MetadataIndex::Compact() {
+    std::string temporary_path = CompactionTemporaryPath();
+    try {
+        // Works from the files alone so lookups keep running against the mapped snapshot meanwhile
+        struct stat rotated_stat;
+        if (WriteCompactedSnapshot(temporary_path, rotated_stat)) {
+            MetadataLock file_lock(lock_path_);
+            SwapCompactedSnapshotLocked(temporary_path, rotated_stat);
+        }
+    } catch (const std::exception& e) {
+        // The rotated journal stays in place, is replayed on every load and folded by the next compaction
+        unlink(temporary_path.c_str());
+        std::cerr << "Metadata compaction failed: " << e.what() << std::endl;
+    }
+    compacting_ = false;
+}
+
+/// Write the snapshot with the rotated journal folded in to a temporary file
+/// \param rotated_stat    Set to the rotated journal that was folded, for the swap to check against
+/// \return                false if there is no rotated journal
+bool MetadataIndex::WriteCompactedSnapshot(const std::string& temporary_path, struct stat& rotated_stat) {
+    if (stat(compacting_path_.c_str(), &rotated_stat) != 0) {
+        return false;
+    }
+    std::map<std::string, std::string> entries;
+    MetadataStore current;
+    if (current.Open(snapshot_path_)) {
+        current.ForEach([&entries](std::string_view key, std::string_view value) {
+            entries.emplace_hint(entries.end(), key, value);
+        });
+    }
+    current.Close();
+    uint64_t examined = 0;
+    uint64_t replayed = MetadataJournal::Replay(compacting_path_, 0,
+        [&entries](const std::string& key, const std::string& value) { entries[key] = value; }, nullptr, &examined);
+    // Folding only part of it and then dropping the rotated journal would lose every mapping after the damage
+    if (replayed != examined) {
+        throw std::runtime_error("Rotated metadata journal has a damaged record at offset " + std::to_string(replayed) +
+                                 ", leaving it in place");
+    }
+    MetadataStore::Write(temporary_path, entries);
+    return true;
+}
+
+/// Replace the snapshot and drop the rotated journal in one step, so other processes loading see either both
+/// the old files or both the new ones. Skipped if the rotated journal was folded by someone else meanwhile,
+/// whose snapshot may already hold newer records. Caller holds the metadata lock
+void MetadataIndex::SwapCompactedSnapshotLocked(const std::string& temporary_path, const struct stat& rotated_stat) {
+    struct stat current;
+    if (stat(compacting_path_.c_str(), &current) != 0 || current.st_ino != rotated_stat.st_ino ||
+        current.st_size != rotated_stat.st_size) {
+        unlink(temporary_path.c_str());
+        return;
+    }
+    // The foreground remaps the new snapshot on its next lookup, which is cheap now
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    if (std::rename(temporary_path.c_str(), snapshot_path_.c_str()) != 0) {
+        throw std::runtime_error("Failed to replace structure.bin");
+    }
+    unlink(compacting_path_.c_str());
+}
+
+// Per process, so a leftover being folded here never shares a file with another process's compaction
+std::string MetadataIndex::CompactionTemporaryPath() const {
+    return snapshot_path_ + ".tmp." + std::to_string(getpid());
+}
+
+/// Rewrite a snapshot from an older format version in place. Caller holds the metadata lock; the temporary
+/// file is named apart from the compaction's, which this process may be writing at the same time
+void MetadataIndex::UpgradeSnapshot() {
+    std::map<std::string, std::string> entries;
+    snapshot_.ForEach([&entries](std::string_view key, std::string_view value) {
+        entries.emplace_hint(entries.end(), key, value);
+    });
+
+    std::string temporary_path = snapshot_path_ + ".upgrade." + std::to_string(getpid());
+    MetadataStore::Write(temporary_path, entries);
+    if (std::rename(temporary_path.c_str(), snapshot_path_.c_str()) != 0 ||
+        stat(snapshot_path_.c_str(), &snapshot_stat_) != 0 || !snapshot_.Open(snapshot_path_)) {
+        throw std::runtime_error("Failed to upgrade structure.bin file");
+    }
+}
+
+void MetadataIndex::Index(const std::string& randomized_name, const std::string& plaintext) {
+    auto [existing, added] = randomized_to_plaintext_.emplace(randomized_name, plaintext);
+    if (!added) {
+        if (existing->second == plaintext) {
+            return;
+        }
+        std::string previous = std::move(existing->second);
+        existing->second = plaintext;
+        Unindex(randomized_name, previous);
+    }
+    auto [parent, name] = MetadataStore::SplitParent(plaintext);
+    children_[std::string(parent)].emplace_back(randomized_name, name);
+
+    // Keep the smallest key on duplicate values
+    auto [it, inserted] = plaintext_to_randomized_.emplace(plaintext, randomized_name);
+    if (!inserted && randomized_name < it->second) {
+        it->second = randomized_name;
+    }
+}
+
+/// Drop the child and reverse entries of a key whose journal value was replaced
+void MetadataIndex::Unindex(const std::string& randomized_name, const std::string& previous) {
+    auto [parent, name] = MetadataStore::SplitParent(previous);
+    auto siblings = children_.find(std::string(parent));
+    if (siblings != children_.end()) {
+        auto& entries = siblings->second;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&randomized_name](const auto& entry) {
+                                         return entry.first == randomized_name;
+                                     }),
+                      entries.end());
+        if (entries.empty()) {
+            children_.erase(siblings);
+        }
+    }
+
+    auto reverse = plaintext_to_randomized_.find(previous);
+    if (reverse == plaintext_to_randomized_.end() || reverse->second != randomized_name) {
+        return;
+    }
+    plaintext_to_randomized_.erase(reverse);
+    // Another journal key may still carry the old value; the smallest of them takes over
+    for (const auto& [key, value] : randomized_to_plaintext_) {
+        if (value != previous) {
+            continue;
+        }
+        auto [it, inserted] = plaintext_to_randomized_.emplace(value, key);
+        if (!inserted && key < it->second) {
+            it->second = key;
+        }
+    }
+}
+
+EntryType MetadataIndex::ResolveType(const std::string& parent, const std::string& randomized_name) {
+    {
+        std::lock_guard<std::mutex> lock(types_mutex_);
+        auto cached = entry_types_.find(randomized_name);
+        if (cached != entry_types_.end()) {
+            return cached->second;
+        }
+    }
+
+    struct stat entry_stat;
+    fs::path entry_path = root_path_ / fs::path(parent).relative_path() / randomized_name;
+    if (stat(entry_path.c_str(), &entry_stat) != 0) {
+        return EntryType::Unknown;
+    }
+    EntryType type = S_ISDIR(entry_stat.st_mode) ? EntryType::Directory
+                   : S_ISREG(entry_stat.st_mode) ? EntryType::File
+                   : EntryType::Unknown;
+    if (type != EntryType::Unknown) {
+        std::lock_guard<std::mutex> lock(types_mutex_);
+        entry_types_[randomized_name] = type;
+    }
+    return type;
+}
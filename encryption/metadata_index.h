@@ -0,0 +1,163 @@
+/*
+* Metadata Index: Serves the randomized <-> plaintext name mapping for the lifetime of the process.
+* The compacted snapshot (common/structure.bin) is memory-mapped and queried in place; mappings
+* appended to common/structure.journal since the last compaction are kept in hash maps on top of it.
+* Lookups share a reader lock and only take it exclusively when there are new records to catch up on;
+* inserts are exclusive within the process and, through MetadataLock, across processes.
+*/
+
+#ifndef METADATA_INDEX_H
+#define METADATA_INDEX_H
+
+#include "helpers/json_fwd.hpp"
+#include "encryption/metadata_journal.h"
+#include "encryption/metadata_lock.h"
+#include "encryption/metadata_store.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define JOURNAL_COMPACTION_THRESHOLD 4096 //records
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+enum class EntryType {
+    Unknown,    // registered in metadata but not (or not yet) present on disk
+    File,
+    Directory
+};
+
+struct ChildEntry {
+    std::string randomized_name;
+    std::string plaintext_name;
+    EntryType type;
+};
+
+class MetadataIndex {
+public:
+    using NameGenerator = std::function<std::string()>;
+    using Chain = std::pair<std::string, std::vector<std::string>>;
+
+    static MetadataIndex& Instance(const std::string& path_to_metadata);
+    ~MetadataIndex();
+
+    void Load();
+    bool Contains(const std::string& randomized_name);
+    std::string GetPlaintext(const std::string& randomized_name);
+    std::string GetRandomized(const std::string& plaintext);
+    std::vector<std::string> GetRandomized(const std::vector<std::string>& plaintexts);
+    void Insert(const std::string& randomized_name, const std::string& plaintext);
+    void Insert(const std::vector<std::pair<std::string, std::string>>& mappings);
+    std::string InsertNew(const std::string& plaintext, const NameGenerator& generate_name);
+    std::string GetOrInsert(const std::string& plaintext, const NameGenerator& generate_name);
+    std::vector<std::string> GetOrInsertChain(const std::string& parent, const std::vector<std::string>& names,
+                                              const NameGenerator& generate_name);
+    std::vector<std::vector<std::string>> GetOrInsertChains(const std::vector<Chain>& chains,
+                                                            const NameGenerator& generate_name);
+    std::vector<ChildEntry> GetChildren(const std::string& parent);
+    json ToJson();
+    void RefreshIfChanged();
+
+private:
+    // The metadata lock plus mutex_ held exclusively, as every writer takes them; marks the index so a reload
+    // under it doesn't try to take the metadata lock a second time
+    class WriteLock {
+    public:
+        explicit WriteLock(MetadataIndex& index)
+            : index_(index), file_lock_(index.lock_path_), lock_(index.mutex_) {
+            index_.file_locked_ = true;
+        }
+        ~WriteLock() {
+            index_.file_locked_ = false;
+        }
+
+    private:
+        MetadataIndex& index_;
+        MetadataLock file_lock_;
+        std::unique_lock<std::shared_mutex> lock_;
+    };
+
+    explicit MetadataIndex(const fs::path& metadata_directory);
+    std::shared_lock<std::shared_mutex> ReadLock();
+    bool NeedsRefresh();
+    void LoadLocked();
+    bool SnapshotNeedsConversion() const;
+    void RefreshLocked();
+    void AppendLocked(const std::vector<std::pair<std::string, std::string>>& mappings);
+    std::string InsertGenerated(const std::string& plaintext, const NameGenerator& generate_name, bool reuse_existing);
+    bool ContainsLocked(const std::string& randomized_name);
+    bool SnapshotChanged();
+    void ReplayJournalTail();
+    void ReplayRotatedJournal();
+    void StartCompaction();
+    void Compact();
+    bool WriteCompactedSnapshot(const std::string& temporary_path, struct stat& rotated_stat);
+    void SwapCompactedSnapshotLocked(const std::string& temporary_path, const struct stat& rotated_stat);
+    std::string CompactionTemporaryPath() const;
+    void UpgradeSnapshot();
+    void Index(const std::string& randomized_name, const std::string& plaintext);
+    void Unindex(const std::string& randomized_name, const std::string& previous);
+    std::string FindRandomized(const std::string& plaintext);
+    bool IsRemapped(const std::string& randomized_name) const;
+    EntryType ResolveType(const std::string& parent, const std::string& randomized_name);
+
+    fs::path root_path_;
+    std::string legacy_snapshot_path_;
+    std::string snapshot_path_;
+    std::string journal_path_;
+    std::string compacting_path_;
+    std::string lock_path_;
+
+    // Guards everything below except entry_types_; held shared by lookups and exclusively by refreshes and inserts
+    std::shared_mutex mutex_;
+    MetadataStore snapshot_;
+    // Journal records not yet compacted into the snapshot
+    std::unordered_map<std::string, std::string> randomized_to_plaintext_;
+    std::unordered_map<std::string, std::string> plaintext_to_randomized_;
+    std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>> children_;
+    // Entry types never change once an entry exists on disk, so each is stat()ed until found once.
+    // Filled in by lookups, which only hold mutex_ shared
+    std::mutex types_mutex_;
+    std::unordered_map<std::string, EntryType> entry_types_;
+    bool loaded_ = false;
+    // Set by WriteLock while this process holds the metadata lock
+    bool file_locked_ = false;
+
+    // Identity of the snapshot we last read, shared with the compaction thread which replaces it
+    std::mutex snapshot_mutex_;
+    struct stat snapshot_stat_ = {};
+
+    // Journal inode, how far into it we have replayed, and how much of it we have looked at: more than was
+    // replayed while a record is torn, which is only read again once the journal grows
+    ino_t journal_ino_ = 0;
+    uint64_t journal_offset_ = 0;
+    uint64_t journal_examined_ = 0;
+    size_t journal_records_ = 0;
+
+    // A leftover rotated journal that couldn't be folded, not retried until it is replaced
+    ino_t damaged_rotated_ino_ = 0;
+
+    std::thread compaction_thread_;
+    std::atomic<bool> compacting_{false};
+};
+
+#endif // METADATA_INDEX_H
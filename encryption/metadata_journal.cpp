@@ -0,0 +1,153 @@
+#include "encryption/metadata_journal.h"
+
+/// Append one mapping to the journal with a single write so the record is never interleaved
+/// \param journal_path    Path of the journal file, created if missing
+void MetadataJournal::Append(const std::string& journal_path, const std::string& key, const std::string& value) {
+    Append(journal_path, {{key, value}});
+}
+
+/// Append several mappings with a single write, so other processes see all of them or none.
+/// Caller holds the metadata lock: a write that comes up short is cut off again before anyone appends after it
+void MetadataJournal::Append(const std::string& journal_path, const std::vector<std::pair<std::string, std::string>>& records) {
+    int fd = ::open(journal_path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open metadata journal");
+    }
+    struct stat journal_stat;
+    if (fstat(fd, &journal_stat) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat metadata journal");
+    }
+
+    std::vector<char> buffer;
+    // A new journal is framed; one that predates framing keeps its layout until compaction replaces it
+    bool framed = journal_stat.st_size == 0 || IsFramed(fd);
+    if (journal_stat.st_size == 0) {
+        buffer.insert(buffer.end(), JOURNAL_MAGIC, JOURNAL_MAGIC + JOURNAL_FILE_HEADER_SIZE);
+    }
+    size_t header_size = framed ? JOURNAL_RECORD_HEADER_SIZE : JOURNAL_LEGACY_RECORD_HEADER_SIZE;
+    for (const auto& [key, value] : records) {
+        uint32_t key_length = key.size();
+        uint32_t value_length = value.size();
+
+        size_t position = buffer.size();
+        buffer.resize(position + header_size + key.size() + value.size());
+        char* record = buffer.data() + position;
+        std::memcpy(record, &key_length, sizeof(key_length));
+        std::memcpy(record + sizeof(key_length), &value_length, sizeof(value_length));
+        std::memcpy(record + header_size, key.data(), key.size());
+        std::memcpy(record + header_size + key.size(), value.data(), value.size());
+        if (framed) {
+            // Covers the lengths and the bytes, but not the checksum field itself
+            uint32_t checksum = Checksum(Checksum(0, record, 2 * sizeof(uint32_t)), record + header_size,
+                                         key.size() + value.size());
+            std::memcpy(record + 2 * sizeof(uint32_t), &checksum, sizeof(checksum));
+        }
+    }
+
+    ssize_t written = ::write(fd, buffer.data(), buffer.size());
+    if (written != static_cast<ssize_t>(buffer.size())) {
+        // Leave no partial record for the next append to land behind
+        if (ftruncate(fd, journal_stat.st_size) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to append to metadata journal, and to remove the partial record");
+        }
+        ::close(fd);
+        throw std::runtime_error("Failed to append to metadata journal");
+    }
+    ::close(fd);
+}
+
+/// Feed every complete record after `offset` to `handler`
+/// \param records     Incremented once per replayed record when not null
+/// \param examined    Set to how far into the file was read when not null; past the return value if the
+///                    journal ends in a torn record
+/// \return            Offset just past the last complete record; a torn trailing record is left for later
+uint64_t MetadataJournal::Replay(const std::string& journal_path, uint64_t offset, const RecordHandler& handler,
+                                 size_t* records, uint64_t* examined) {
+    if (examined) {
+        *examined = offset;
+    }
+    int fd = ::open(journal_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return offset;
+    }
+
+    bool framed = IsFramed(fd);
+    if (framed && offset < JOURNAL_FILE_HEADER_SIZE) {
+        offset = JOURNAL_FILE_HEADER_SIZE;
+    }
+    std::vector<char> buffer;
+    char chunk[64 * 1024];
+    ssize_t n;
+    while ((n = ::pread(fd, chunk, sizeof(chunk), offset + buffer.size())) > 0) {
+        buffer.insert(buffer.end(), chunk, chunk + n);
+    }
+    ::close(fd);
+    if (examined) {
+        *examined = offset + buffer.size();
+    }
+
+    size_t header_size = framed ? JOURNAL_RECORD_HEADER_SIZE : JOURNAL_LEGACY_RECORD_HEADER_SIZE;
+    size_t position = 0;
+    while (buffer.size() - position >= header_size) {
+        const char* record = buffer.data() + position;
+        uint32_t key_length, value_length;
+        std::memcpy(&key_length, record, sizeof(key_length));
+        std::memcpy(&value_length, record + sizeof(key_length), sizeof(value_length));
+        size_t record_size = header_size + size_t(key_length) + value_length;
+        if (buffer.size() - position < record_size) {
+            break;
+        }
+        const char* data = record + header_size;
+        if (framed) {
+            uint32_t checksum;
+            std::memcpy(&checksum, record + 2 * sizeof(uint32_t), sizeof(checksum));
+            if (checksum != Checksum(Checksum(0, record, 2 * sizeof(uint32_t)), data, size_t(key_length) + value_length)) {
+                break;
+            }
+        }
+        handler(std::string(data, key_length), std::string(data + key_length, value_length));
+        if (records) {
+            ++*records;
+        }
+        position += record_size;
+    }
+    return offset + position;
+}
+
+/// Cut off a torn record left by a writer that died mid-append, so the next record starts at a record boundary.
+/// Caller holds the metadata lock, so nothing past `offset` can be an append still in progress
+/// \param offset    Just past the last complete record, as returned by Replay
+void MetadataJournal::TruncateTail(const std::string& journal_path, uint64_t offset) {
+    if (::truncate(journal_path.c_str(), offset) != 0) {
+        throw std::runtime_error("Failed to remove a torn record from the metadata journal");
+    }
+}
+
+bool MetadataJournal::IsFramed(int fd) {
+    char magic[JOURNAL_FILE_HEADER_SIZE];
+    return ::pread(fd, magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic)) &&
+           std::memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0;
+}
+
+// CRC-32 (IEEE 802.3, reflected), the checksum zlib and most file formats use; like zlib's crc32(), pass the
+// previous result to continue over more bytes, 0 to start
+uint32_t MetadataJournal::Checksum(uint32_t crc, const char* data, size_t size) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320u : 0);
+            }
+            entries[i] = crc;
+        }
+        return entries;
+    }();
+    crc ^= 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
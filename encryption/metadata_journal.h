@@ -0,0 +1,45 @@
+/*
+* Metadata Journal: Append-only log of name mappings kept next to common/structure.json.
+* New mappings are appended as single records instead of rewriting the whole snapshot.
+* Journals start with a magic and every record carries a CRC32, so a record torn by a crash or a full disk
+* is recognized instead of being read as lengths and bytes of the records after it. Journals written before
+* records were framed have no magic and are read and appended to in the old layout until they are compacted.
+*/
+
+#ifndef METADATA_JOURNAL_H
+#define METADATA_JOURNAL_H
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define JOURNAL_MAGIC "SECFSJ2\n"
+#define JOURNAL_FILE_HEADER_SIZE 8 //bytes, the magic
+// Record layout: uint32 key length | uint32 value length | uint32 CRC32 of lengths and bytes | key bytes | value bytes
+#define JOURNAL_RECORD_HEADER_SIZE 12 //bytes
+// Before the magic: uint32 key length | uint32 value length | key bytes | value bytes
+#define JOURNAL_LEGACY_RECORD_HEADER_SIZE 8 //bytes
+
+class MetadataJournal {
+public:
+    using RecordHandler = std::function<void(const std::string& key, const std::string& value)>;
+
+    static void Append(const std::string& journal_path, const std::string& key, const std::string& value);
+    static void Append(const std::string& journal_path, const std::vector<std::pair<std::string, std::string>>& records);
+    static uint64_t Replay(const std::string& journal_path, uint64_t offset, const RecordHandler& handler,
+                           size_t* records = nullptr, uint64_t* examined = nullptr);
+    static void TruncateTail(const std::string& journal_path, uint64_t offset);
+
+private:
+    static bool IsFramed(int fd);
+    static uint32_t Checksum(uint32_t crc, const char* data, size_t size);
+};
+
+#endif // METADATA_JOURNAL_H
@@ -0,0 +1,22 @@
+#include "encryption/metadata_lock.h"
+
+/// Block until this process holds the lock exclusively. Each lock opens its own descriptor, so threads of
+/// one process exclude each other as well
+/// \param lock_path    Created if missing
+MetadataLock::MetadataLock(const std::string& lock_path) {
+    fd_ = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open " + lock_path);
+    }
+    while (::flock(fd_, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            ::close(fd_);
+            throw std::runtime_error("Failed to lock " + lock_path);
+        }
+    }
+}
+
+// Closing the descriptor releases the lock
+MetadataLock::~MetadataLock() {
+    ::close(fd_);
+}
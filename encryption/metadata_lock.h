@@ -0,0 +1,29 @@
+/*
+* Metadata Lock: flock() on common/structure.lock, coordinating metadata writers across processes.
+* Only writers take it: inserting mappings and rotating the journal for compaction are exclusive, so a
+* check-then-insert can't race another process and no append can land in a journal that is being folded
+* away. Readers never lock, the snapshot is replaced by rename and the journal only grows.
+*/
+
+#ifndef METADATA_LOCK_H
+#define METADATA_LOCK_H
+
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/file.h>
+#include <unistd.h>
+
+class MetadataLock {
+public:
+    explicit MetadataLock(const std::string& lock_path);
+    ~MetadataLock();
+    MetadataLock(const MetadataLock&) = delete;
+    MetadataLock& operator=(const MetadataLock&) = delete;
+
+private:
+    int fd_;
+};
+
+#endif // METADATA_LOCK_H
@@ -0,0 +1,243 @@
+#include "encryption/metadata_store.h"
+
+#include "helpers/json.hpp"
+
+MetadataStore::~MetadataStore() {
+    Close();
+}
+
+/// Map a store file read-only
+/// \return false if the file doesn't exist; throws if it exists but is malformed
+bool MetadataStore::Open(const std::string& store_path) {
+    Close();
+
+    int fd = ::open(store_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat store_stat;
+    if (fstat(fd, &store_stat) != 0 || static_cast<size_t>(store_stat.st_size) < sizeof(Header)) {
+        ::close(fd);
+        throw std::runtime_error("Metadata store is truncated: " + store_path);
+    }
+    void* mapping = mmap(nullptr, store_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map metadata store: " + store_path);
+    }
+    mapping_ = mapping;
+    mapping_size_ = store_stat.st_size;
+
+    const Header* header = static_cast<const Header*>(mapping_);
+    uint64_t tables_end = sizeof(Header) + uint64_t(header->entry_count) * (sizeof(Entry) + sizeof(uint32_t));
+    // Version 1 sorted the value order by whole value; it is still readable but gets rewritten
+    if (std::memcmp(header->magic, METADATA_STORE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version < 1 || header->version > METADATA_STORE_VERSION ||
+        header->heap_offset < tables_end ||
+        header->heap_offset > mapping_size_ ||
+        header->heap_size > mapping_size_ - header->heap_offset) {
+        Close();
+        throw std::runtime_error("Metadata store is corrupt: " + store_path);
+    }
+
+    const char* base = static_cast<const char*>(mapping_);
+    header_ = header;
+    entries_ = reinterpret_cast<const Entry*>(base + sizeof(Header));
+    value_order_ = reinterpret_cast<const uint32_t*>(base + sizeof(Header) + uint64_t(header->entry_count) * sizeof(Entry));
+    heap_ = base + header->heap_offset;
+    return true;
+}
+
+void MetadataStore::Close() {
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+    }
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+    header_ = nullptr;
+    entries_ = nullptr;
+    value_order_ = nullptr;
+    heap_ = nullptr;
+}
+
+uint32_t MetadataStore::Size() const {
+    return header_ ? header_->entry_count : 0;
+}
+
+uint32_t MetadataStore::Version() const {
+    return header_ ? header_->version : 0;
+}
+
+/// Split a stored path into its parent directory and final name: "/filesystem/a/b" -> ("/filesystem/a", "b")
+std::pair<std::string_view, std::string_view> MetadataStore::SplitParent(std::string_view value) {
+    size_t slash = value.find_last_of('/');
+    if (slash == std::string_view::npos) {
+        return {std::string_view(), value};
+    }
+    return {value.substr(0, slash), value.substr(slash + 1)};
+}
+
+bool MetadataStore::ValueLess(std::string_view a, std::string_view b) {
+    return SplitParent(a) < SplitParent(b);
+}
+
+std::string_view MetadataStore::KeyAt(uint32_t position) const {
+    const char* key = entries_[position].key;
+    return std::string_view(key, strnlen(key, METADATA_KEY_SIZE));
+}
+
+std::string_view MetadataStore::ValueAt(uint32_t position) const {
+    const Entry& entry = entries_[position];
+    if (uint64_t(entry.value_offset) + entry.value_length > header_->heap_size) {
+        throw std::runtime_error("Metadata store entry points outside the heap");
+    }
+    return std::string_view(heap_ + entry.value_offset, entry.value_length);
+}
+
+/// \return The key table position of the entry ranked `rank` in value order
+uint32_t MetadataStore::OrderAt(uint32_t rank) const {
+    uint32_t position = value_order_[rank];
+    if (position >= header_->entry_count) {
+        throw std::runtime_error("Metadata store value order points outside the key table");
+    }
+    return position;
+}
+
+/// Binary search the key table
+bool MetadataStore::Find(const std::string& key, std::string& value) const {
+    uint32_t low = 0, high = Size();
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        int order = KeyAt(middle).compare(key);
+        if (order == 0) {
+            value = ValueAt(middle);
+            return true;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return false;
+}
+
+/// First position in the value order table not below (parent, name)
+uint32_t MetadataStore::LowerBound(std::string_view parent, std::string_view name) const {
+    uint32_t low = 0, high = Size();
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (SplitParent(ValueAt(OrderAt(middle))) < std::make_pair(parent, name)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/// Binary search the value order table; on duplicate values the smallest key wins
+bool MetadataStore::FindKey(const std::string& value, std::string& key) const {
+    if (Version() < METADATA_STORE_VERSION) {
+        throw std::runtime_error("Metadata store needs to be rewritten before reverse lookups");
+    }
+    auto [parent, name] = SplitParent(value);
+    uint32_t position = LowerBound(parent, name);
+    if (position < Size() && ValueAt(OrderAt(position)) == value) {
+        key = KeyAt(OrderAt(position));
+        return true;
+    }
+    return false;
+}
+
+void MetadataStore::ForEach(const std::function<void(std::string_view key, std::string_view value)>& handler) const {
+    for (uint32_t position = 0; position < Size(); ++position) {
+        handler(KeyAt(position), ValueAt(position));
+    }
+}
+
+/// Visit the entries stored directly under `parent`, e.g. "/filesystem/<user>/<personal>"
+void MetadataStore::ForEachChild(const std::string& parent, const std::function<void(std::string_view key, std::string_view name)>& handler) const {
+    if (Version() < METADATA_STORE_VERSION) {
+        throw std::runtime_error("Metadata store needs to be rewritten before listing children");
+    }
+    for (uint32_t position = LowerBound(parent, std::string_view()); position < Size(); ++position) {
+        uint32_t entry = OrderAt(position);
+        auto [entry_parent, name] = SplitParent(ValueAt(entry));
+        if (entry_parent != parent) {
+            break;
+        }
+        handler(KeyAt(entry), name);
+    }
+}
+
+/// Serialize a complete mapping; callers write to a temporary path and rename it into place
+void MetadataStore::Write(const std::string& store_path, const std::map<std::string, std::string>& entries) {
+    Header header = {};
+    std::memcpy(header.magic, METADATA_STORE_MAGIC, sizeof(header.magic));
+    header.version = METADATA_STORE_VERSION;
+    header.entry_count = entries.size();
+    header.heap_offset = sizeof(Header) + entries.size() * (sizeof(Entry) + sizeof(uint32_t));
+
+    // std::map iterates in key order, which is the order the key table must be in
+    std::vector<Entry> table;
+    std::vector<std::string_view> values;
+    table.reserve(entries.size());
+    values.reserve(entries.size());
+    std::string heap;
+    for (const auto& [key, value] : entries) {
+        if (key.empty() || key.size() > METADATA_KEY_SIZE) {
+            throw std::runtime_error("Metadata key doesn't fit the store: " + key);
+        }
+        Entry entry = {};
+        std::memcpy(entry.key, key.data(), key.size());
+        entry.value_offset = heap.size();
+        entry.value_length = value.size();
+        heap += value;
+        table.push_back(entry);
+        values.push_back(value);
+    }
+    header.heap_size = heap.size();
+
+    std::vector<uint32_t> value_order(entries.size());
+    for (uint32_t i = 0; i < value_order.size(); ++i) {
+        value_order[i] = i;
+    }
+    // Ties keep key order, so the first match of a value is its smallest key
+    std::stable_sort(value_order.begin(), value_order.end(), [&values](uint32_t a, uint32_t b) {
+        return ValueLess(values[a], values[b]);
+    });
+
+    std::ofstream file(store_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(Entry));
+    file.write(reinterpret_cast<const char*>(value_order.data()), value_order.size() * sizeof(uint32_t));
+    file.write(heap.data(), heap.size());
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Failed to write metadata store: " + store_path);
+    }
+}
+
+/// One-time conversion of a legacy structure.json; the JSON file is left untouched
+/// \return Number of migrated entries
+size_t MetadataStore::MigrateFromJson(const std::string& json_path, const std::string& store_path) {
+    std::ifstream metadata_file(json_path);
+    if (!metadata_file.is_open()) {
+        throw std::runtime_error("Failed to open " + json_path);
+    }
+    json metadata_json = json::parse(metadata_file);
+
+    std::map<std::string, std::string> entries;
+    for (auto& [key, value] : metadata_json.items()) {
+        entries[key] = value.get<std::string>();
+    }
+
+    // Per process, so a concurrent migration of the same tree can't write into our file
+    std::string temporary_path = store_path + ".tmp." + std::to_string(getpid());
+    Write(temporary_path, entries);
+    if (std::rename(temporary_path.c_str(), store_path.c_str()) != 0) {
+        throw std::runtime_error("Failed to move metadata store into place: " + store_path);
+    }
+    return entries.size();
+}
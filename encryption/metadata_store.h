@@ -0,0 +1,90 @@
+/*
+* Metadata Store: Compact binary snapshot of the name mapping (common/structure.bin) that is
+* memory-mapped and queried in place instead of being parsed.
+*
+* Layout (host byte order):
+*   header         magic "SFSMETA1" | uint32 version | uint32 entry count | uint64 heap offset | uint64 heap size
+*   entries        entry count x { char key[16] (zero padded) | uint32 value offset | uint32 value length }, sorted by key
+*   value order    entry count x uint32 entry number, sorted by (parent path, name, key) so reverse
+*                  lookups are a binary search and the children of a directory are contiguous
+*   heap           value bytes
+*/
+
+#ifndef METADATA_STORE_H
+#define METADATA_STORE_H
+
+#include "helpers/json_fwd.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#define METADATA_STORE_MAGIC "SFSMETA1"
+#define METADATA_STORE_VERSION 2
+#define METADATA_KEY_SIZE 16 //bytes
+
+using json = nlohmann::json;
+
+class MetadataStore {
+public:
+    MetadataStore() = default;
+    ~MetadataStore();
+    MetadataStore(const MetadataStore&) = delete;
+    MetadataStore& operator=(const MetadataStore&) = delete;
+
+    bool Open(const std::string& store_path);
+    void Close();
+    uint32_t Size() const;
+    uint32_t Version() const;
+    bool Find(const std::string& key, std::string& value) const;
+    bool FindKey(const std::string& value, std::string& key) const;
+    void ForEach(const std::function<void(std::string_view key, std::string_view value)>& handler) const;
+    void ForEachChild(const std::string& parent, const std::function<void(std::string_view key, std::string_view name)>& handler) const;
+
+    static std::pair<std::string_view, std::string_view> SplitParent(std::string_view value);
+
+    static void Write(const std::string& store_path, const std::map<std::string, std::string>& entries);
+    static size_t MigrateFromJson(const std::string& json_path, const std::string& store_path);
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_count;
+        uint64_t heap_offset;
+        uint64_t heap_size;
+    };
+
+    struct Entry {
+        char key[METADATA_KEY_SIZE];
+        uint32_t value_offset;
+        uint32_t value_length;
+    };
+
+    std::string_view KeyAt(uint32_t position) const;
+    std::string_view ValueAt(uint32_t position) const;
+    uint32_t OrderAt(uint32_t rank) const;
+    uint32_t LowerBound(std::string_view parent, std::string_view name) const;
+    static bool ValueLess(std::string_view a, std::string_view b);
+
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    const Header* header_ = nullptr;
+    const Entry* entries_ = nullptr;
+    const uint32_t* value_order_ = nullptr;
+    const char* heap_ = nullptr;
+};
+
+#endif // METADATA_STORE_H
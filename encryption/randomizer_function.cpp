@@ -0,0 +1,106 @@
+#include "encryption/randomizer_function.h"
+
+#include "helpers/json.hpp"
+
+// Drawn from OpenSSL's generator, which is safe to call from several threads and reseeds after fork(),
+// so sessions forked from the server don't all produce the same names
+std::string FilenameRandomizer::GenerateRandomString(int length) {
+    static const char alphanum[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz";
+    const unsigned alphabet_size = sizeof(alphanum) - 1;
+    // Bytes at or above this would favour the first letters of the alphabet
+    const unsigned unbiased_limit = 256 - 256 % alphabet_size;
+
+    std::string randomString;
+    randomString.reserve(length);
+
+    unsigned char bytes[32];
+    while (randomString.size() < static_cast<size_t>(length)) {
+        if (1 != RAND_bytes(bytes, sizeof(bytes))) {
+            throw std::runtime_error("Failed to generate random name");
+        }
+        for (size_t i = 0; i < sizeof(bytes) && randomString.size() < static_cast<size_t>(length); ++i) {
+            if (bytes[i] < unbiased_limit) {
+                randomString += alphanum[bytes[i] % alphabet_size];
+            }
+        }
+    }
+
+    return randomString;
+}
+
+json FilenameRandomizer::ReadMetadata(const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).ToJson();
+}
+
+// Maps the metadata store and replays its journal up front so the first command doesn't pay for it;
+// an index that is already loaded, e.g. inherited from the session server, only catches up
+void FilenameRandomizer::LoadMetadata(const std::string& path_to_metadata) {
+    MetadataIndex::Instance(path_to_metadata).RefreshIfChanged();
+}
+
+std::string FilenameRandomizer::GetFilename(const std::string& randomized_name, const std::string& path_to_metadata) {
+    std::string decrypted_name = MetadataIndex::Instance(path_to_metadata).GetPlaintext(randomized_name);
+    if (decrypted_name.empty()) {
+        return "";
+    }
+    return fs::path(decrypted_name).filename();
+}
+
+std::string FilenameRandomizer::GetRandomizedName(const std::string& filename, const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).GetRandomized(filename);
+}
+
+std::vector<std::string> FilenameRandomizer::GetRandomizedNames(const std::vector<std::string>& filenames, const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).GetRandomized(filenames);
+}
+
+std::string FilenameRandomizer::GetRandomizedFilePath(const std::string& filepath, const std::string& path_to_metadata) {
+    fs::path path(filepath);
+    fs::path randomized_path;
+    for (const auto& part : path) {
+        randomized_path /= GetRandomizedName(part.string(), path_to_metadata);
+    }
+    return randomized_path.string();
+}
+
+std::string FilenameRandomizer::GetPlaintextFilePath(const std::string& randomized_filepath, const std::string& path_to_metadata) {
+    fs::path path(randomized_filepath);
+    fs::path plaintext_path;
+    for (const auto& part : path) {
+        plaintext_path /= GetFilename(part.string(), path_to_metadata);
+    }
+    return plaintext_path.string();
+}
+
+std::string FilenameRandomizer::EncryptFilename(const std::string& filename, const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).InsertNew(filename, []() { return GenerateRandomString(10); });
+}
+
+// Same as EncryptFilename unless the path is registered already, then its randomized name is reused;
+// the check and the insert happen under one metadata lock, so concurrent sessions agree on the name
+std::string FilenameRandomizer::GetOrEncryptFilename(const std::string& filename, const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).GetOrInsert(filename, []() { return GenerateRandomString(10); });
+}
+
+// Randomized names for a chain of nested directories below parent_path, registering the missing ones in a
+// single metadata commit
+std::vector<std::string> FilenameRandomizer::GetOrEncryptPath(const std::string& parent_path, const std::vector<std::string>& names, const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).GetOrInsertChain(parent_path, names, []() { return GenerateRandomString(10); });
+}
+
+// GetOrEncryptPath for many chains, e.g. the root, personal and shared folders of a batch of new users;
+// the collision checks and the insert of every chain happen under one metadata lock
+std::vector<std::vector<std::string>> FilenameRandomizer::GetOrEncryptPaths(const std::vector<MetadataIndex::Chain>& chains, const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).GetOrInsertChains(chains, []() { return GenerateRandomString(10); });
+}
+
+std::string FilenameRandomizer::DecryptFilename(const std::string& randomized_name, const std::string& path_to_metadata) {
+    return GetFilename(randomized_name, path_to_metadata);
+}
+
+// Entries registered under a randomized directory path such as "/filesystem/<user>/<personal>"
+std::vector<ChildEntry> FilenameRandomizer::ListChildren(const std::string& parent_path, const std::string& path_to_metadata) {
+    return MetadataIndex::Instance(path_to_metadata).GetChildren(parent_path);
+}
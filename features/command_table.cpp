@@ -0,0 +1,45 @@
+#include "features/command_table.h"
+
+CommandLine parseCommandLine(const std::string& text) {
+    CommandLine line;
+    line.text = text;
+    size_t position = 0;
+    while (position < text.size()) {
+        while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) {
+            position++;
+        }
+        size_t start = position;
+        while (position < text.size() && !std::isspace(static_cast<unsigned char>(text[position]))) {
+            position++;
+        }
+        if (position > start) {
+            line.words.push_back(text.substr(start, position - start));
+            line.wordEnds.push_back(position);
+        }
+    }
+    return line;
+}
+
+bool commandTimingEnabled() {
+    const char* configured = std::getenv("SECFS_COMMAND_TIMING");
+    return configured != nullptr && *configured != '\0' && std::string(configured) != "0";
+}
+
+void printCommandStats(const std::map<std::string, CommandStats>& stats, std::ostream& out) {
+    if (stats.empty()) {
+        return;
+    }
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::left << std::setw(10) << "command" << std::right << std::setw(10) << "calls" << std::setw(12)
+        << "total_ms" << std::setw(12) << "mean_us" << std::setw(12) << "max_us" << std::endl;
+    for (const auto& [name, entry] : stats) {
+        double totalUs = std::chrono::duration<double, std::micro>(entry.total).count();
+        double slowestUs = std::chrono::duration<double, std::micro>(entry.slowest).count();
+        out << std::left << std::setw(10) << name << std::right << std::setw(10) << entry.calls << std::fixed
+            << std::setprecision(3) << std::setw(12) << totalUs / 1000 << std::setprecision(1) << std::setw(12)
+            << totalUs / entry.calls << std::setw(12) << slowestUs << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,88 @@
+/*
+* Command Table: How a session line becomes a call. Each line is split into words once, the command name is
+* looked up in a hash table of registered commands, and the argument count is checked against the arity the
+* command declares before its handler runs. Handlers read their arguments from the split line instead of
+* parsing it again. Dispatching in one place is also where commands are timed.
+*/
+
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "features/session.h"
+
+#define COMMAND_UNBOUNDED_ARGS std::numeric_limits<size_t>::max()
+
+struct CommandLine {
+    std::string text;
+    // The command name followed by its arguments, split on whitespace
+    std::vector<std::string> words;
+    // Where each word ends in text
+    std::vector<size_t> wordEnds;
+
+    size_t argCount() const {
+        return words.empty() ? 0 : words.size() - 1;
+    }
+
+    /// \return The index-th argument after the command name, empty if there are fewer
+    const std::string& arg(size_t index) const {
+        static const std::string missing;
+        return index + 1 < words.size() ? words[index + 1] : missing;
+    }
+
+    /// \return Everything after the index-th argument, unsplit and including the whitespace in front of it
+    std::string restAfter(size_t index) const {
+        return index + 1 < wordEnds.size() ? text.substr(wordEnds[index + 1]) : std::string();
+    }
+};
+
+/**
+ * Splits a line into words, the same way `>>` on a stream would.
+ *
+ * @param text The line as read.
+ * @return The split line; no words for a blank line.
+ */
+CommandLine parseCommandLine(const std::string& text);
+
+struct Command {
+    using Handler = std::function<void(const CommandLine& line, Session& session)>;
+
+    Handler handler;
+    size_t minArgs;
+    size_t maxArgs;
+    bool adminOnly;
+    // Printed when the argument count is outside [minArgs, maxArgs]
+    std::string usage;
+};
+
+struct CommandStats {
+    uint64_t calls = 0;
+    std::chrono::nanoseconds total{0};
+    std::chrono::nanoseconds slowest{0};
+};
+
+/**
+ * Whether sessions collect per-command timings, set with SECFS_COMMAND_TIMING=1.
+ */
+bool commandTimingEnabled();
+
+/**
+ * Prints the collected timings, one command per line ordered by name: calls, total ms, mean and slowest in µs.
+ *
+ * @param stats Timings by command name.
+ * @param out Where to print them.
+ */
+void printCommandStats(const std::map<std::string, CommandStats>& stats, std::ostream& out);
+
+#endif // COMMAND_TABLE_H
@@ -0,0 +1,490 @@
+#include "features/features.h"
+
+void printDecryptedCurrentPath(const Session& session) {
+  std::string pwd = getPlaintextPWD(session);
+  std::cout << pwd << std::endl;
+}
+
+void handleChangeDirectory(std::string& directoryName, Session& session) {
+    if(directoryName.empty()) {
+        directoryName = "/";
+        session.cwd = session.root;
+        return;
+    }
+
+    if(directoryName.find('`') != std::string::npos) {
+      std::cerr << "Error: directory name should not contain `backticks`, try again." << std::endl;
+    } 
+    else {
+        if (directoryName == "~" || directoryName == "/"){
+            session.cwd = session.root;
+            return;
+        }
+
+        directoryName = normalizePath(directoryName);
+        directoryName = getEncryptedFilePath(directoryName, session);
+
+        if(directoryName == "." || directoryName == "./") {
+            return;
+        }
+        // An absolute path whose components didn't resolve leaves only the "/"
+        if (directoryName == "/") {
+            session.cwd = session.root;
+            return;
+        }
+
+        fs::path hostTarget = getHostPath(session) / directoryName;
+        if (directoryName.empty() || !(fs::exists(hostTarget) && fs::is_directory(hostTarget))) {
+            std::cout << "ERROR: Path is either not a directory or doesn't exist!" << std::endl;
+            return;
+        }
+
+        // Walk the randomized components from the current directory; climbing above /filesystem or
+        // leaving the session root in any other way keeps the session where it is
+        std::vector<std::string> target = session.cwd;
+        bool outsideRoot = directoryName.front() == '/';
+        std::istringstream components(directoryName);
+        std::string component;
+        while (!outsideRoot && std::getline(components, component, '/')) {
+            if (component.empty() || component == ".") {
+                continue;
+            }
+            if (component == "..") {
+                if (target.empty()) {
+                    outsideRoot = true;
+                } else {
+                    target.pop_back();
+                }
+            } else {
+                target.push_back(component);
+            }
+        }
+        if (outsideRoot || target.size() < session.root.size() ||
+            !std::equal(session.root.begin(), session.root.end(), target.begin())) {
+            std::cerr << "Directory is outside of the root directory." << std::endl;
+            std::cout << "Staying in current directory." << std::endl;
+            return;
+        }
+        session.cwd = target;
+    }
+}
+
+void listDirectoryContents(const Session& session) {
+    std::cout << "d -> ." << std::endl;
+
+    if (!session.cwd.empty()) {
+        std::cout << "d -> .." << std::endl;
+    }
+
+    for (const ChildEntry& child : FilenameRandomizer::ListChildren(getCustomPWD(session), session.filesystemPath)) {
+        if (child.type == EntryType::Directory) {
+            std::cout << "d -> " << child.plaintext_name << std::endl;
+        } else if (child.type == EntryType::File) {
+            std::cout << "f -> " << child.plaintext_name << std::endl;
+        }
+    }
+}
+
+void addContentsToFile(std::string filename, std::string filepath, std::string content) {
+  filepath += "/" + filename;
+  std::ofstream file(filepath, std::ios::app);
+
+  if (file) {
+    file << content << std::endl;
+    file.close();
+  } 
+  else {
+    std::ofstream newFile(filepath);
+    if (newFile) {
+        newFile << content << std::endl;
+    }
+    newFile.close();
+  }
+}
+
+void shareFile(const Session& session, std::string username, std::string filename) {
+    const std::string& filesystemPath = session.filesystemPath;
+    std::string randomizedFilename = FilenameRandomizer::GetRandomizedName(getCustomPWD(session) + "/" + filename, filesystemPath);
+    if (randomizedFilename.empty()) {
+        std::cout << "File does not exist" << std::endl;
+        return;
+    }
+    std::string filePath = getHostPath(session, randomizedFilename).string();
+
+    if (!doesFileExist(filePath) || !doesUserExist(username, filesystemPath)) {
+        return;
+    }
+
+    std::string randomizedUserDirectory = getRandomizedUserDirectory(username, filesystemPath);
+    std::string randomizedSharedDirectory = getRandomizedSharedDirectory(randomizedUserDirectory, filesystemPath);
+    std::vector<uint8_t> shareKey = UserRegistry::Instance(filesystemPath).GetKey(username);
+    std::string filenameKey = "/filesystem/" + randomizedUserDirectory + "/" + randomizedSharedDirectory + "/" + filename;
+    std::string sharedRandomizedFilename = FilenameRandomizer::EncryptFilename(filenameKey, filesystemPath);
+    std::string shareUserPath = filesystemPath + "/filesystem/" + randomizedUserDirectory + "/" + randomizedSharedDirectory + "/" + sharedRandomizedFilename;
+    Encryption::grantAccess(filePath, session.key, shareUserPath, shareKey);
+
+    std::string sharedDataPath = filesystemPath + "/shared";
+    std::string sharedDataContent = username + ":" + filenameKey;
+    addContentsToFile(randomizedFilename, sharedDataPath, sharedDataContent);
+    std::cout << "File shared successfully!" << std::endl;
+}
+
+void processFileAccess(const CommandLine& line, const Session& session) {
+    const std::string& filename = line.arg(0);
+    const std::string& offsetToken = line.arg(1);
+    const std::string& lengthToken = line.arg(2);
+
+    std::string encryptedName;
+    std::vector<uint8_t> fileKey;
+    if (!resolveReadableFile(filename, session, encryptedName, fileKey)) {
+        return;
+    }
+
+    if (!offsetToken.empty()) {
+        uint64_t offset, length;
+        if (!parseByteCount(offsetToken, offset) || !parseByteCount(lengthToken, length)) {
+            std::cout << "Invalid byte range, use: cat <filename> <offset> <length>" << std::endl;
+            return;
+        }
+        std::cout << Encryption::readRange(encryptedName, offset, length, fileKey) << std::endl;
+        return;
+    }
+
+    Encryption::decryptFile(encryptedName, std::cout, fileKey);
+    std::cout << std::endl;
+}
+
+void processFileHeadTail(const CommandLine& line, const Session& session, bool fromEnd) {
+    const std::string& filename = line.arg(0);
+    const std::string& countToken = line.arg(1);
+
+    std::string encryptedName;
+    std::vector<uint8_t> fileKey;
+    if (!resolveReadableFile(filename, session, encryptedName, fileKey)) {
+        return;
+    }
+
+    uint64_t count;
+    if (!parseByteCount(countToken, count)) {
+        std::cout << "Byte count not provided, use: " << (fromEnd ? "tail" : "head") << " <filename> <bytes>" << std::endl;
+        return;
+    }
+
+    uint64_t offset = 0;
+    if (fromEnd) {
+        uint64_t size = Encryption::plaintextSize(encryptedName, fileKey);
+        offset = size > count ? size - count : 0;
+    }
+    std::cout << Encryption::readRange(encryptedName, offset, count, fileKey) << std::endl;
+}
+
+void handleFileSharing(const CommandLine& line, const Session& session) {
+    const std::string& filename = line.arg(0);
+    const std::string& shareUsername = line.arg(1);
+
+    if (!checkIfPersonalDirectory(session.userName, getCustomPWD(session), session.filesystemPath)) {
+        std::cout << "Forbidden" << std::endl;
+        return;
+    }
+
+    if (filename.find('/') != std::string::npos) {
+        std::cout << "File name cannot contain '/'" << std::endl;
+        return;
+    }
+
+    if (isFileSharedWithUser(filename, session, shareUsername)) {
+        std::cout << "A file with name " << filename << " has already been shared with " << shareUsername << std::endl;
+    } else {
+        shareFile(session, shareUsername, filename);
+    }
+}
+
+void createDirectoryInUserSpace(std::string directoryName, const Session& session) {
+  const std::string& filesystemPath = session.filesystemPath;
+  if (!checkIfPersonalDirectory(session.userName, getCustomPWD(session), filesystemPath)) {
+    std::cerr << "Forbidden" << std::endl;
+    return;
+  }
+
+  if (directoryName.find('/') != std::string::npos) {
+    std::cout << "Directory name cannot contain '/'" << std::endl;
+    return;
+  }
+
+  std::string path = getCustomPWD(session) + "/" + directoryName;
+  std::string encryptedName = getEncFilename(directoryName, path, filesystemPath, true);
+  if (!encryptedName.empty() && makeHostDirectory(getHostPath(session, encryptedName))) {
+    std::cout << "Directory created successfully." << std::endl;
+  }
+}
+
+void processCreateDirectoryInUserSpace(std::string directoryName, const Session& session) {
+    if (directoryName.find('/') != std::string::npos || directoryName.find('`') != std::string::npos) {
+        std::cerr << "Directory name cannot contain '/' or '`'" << std::endl;
+        return;
+    }
+    if (!checkIfPersonalDirectory(session.userName, getCustomPWD(session), session.filesystemPath)) {
+        std::cout << "Forbidden: User lacks permission to create directory here." << std::endl;
+        return;
+    }
+    if (directoryName.empty() || directoryName == "filesystem" || directoryName == "." || directoryName == "..") {
+        std::cerr << "Invalid directory name provided." << std::endl;
+        return;
+    }
+    
+    fs::path targetPath = getHostPath(session, directoryName);
+    if (fs::exists(targetPath) && fs::is_directory(targetPath)) {
+        std::cerr << "Directory already exists." << std::endl;
+        return;
+    }
+    try {
+        createDirectoryInUserSpace(directoryName, session);
+    } catch (const fs::filesystem_error& e) {
+        std::cerr << "Failed to create directory: " << e.what() << std::endl;
+    }
+}
+
+void processCreateDirectoryTree(const std::string& directoryPath, const Session& session) {
+    if (directoryPath.find('`') != std::string::npos) {
+        std::cerr << "Directory name cannot contain '`'" << std::endl;
+        return;
+    }
+    if (!checkIfPersonalDirectory(session.userName, getCustomPWD(session), session.filesystemPath)) {
+        std::cout << "Forbidden: User lacks permission to create directory here." << std::endl;
+        return;
+    }
+
+    std::vector<std::string> names;
+    std::istringstream components(directoryPath);
+    std::string name;
+    while (std::getline(components, name, '/')) {
+        if (name.empty()) {
+            continue;
+        }
+        if (name == "filesystem" || name == "." || name == "..") {
+            std::cerr << "Invalid directory name provided." << std::endl;
+            return;
+        }
+        names.push_back(name);
+    }
+    if (names.empty()) {
+        std::cerr << "Invalid directory name provided." << std::endl;
+        return;
+    }
+
+    // A file anywhere along the way stops us before anything is registered
+    std::string parent = getCustomPWD(session);
+    fs::path hostPath = getHostPath(session);
+    for (const std::string& component : names) {
+        std::string randomized = FilenameRandomizer::GetRandomizedName(parent + "/" + component, session.filesystemPath);
+        if (randomized.empty()) {
+            break;
+        }
+        hostPath /= randomized;
+        if (fs::exists(hostPath) && !fs::is_directory(hostPath)) {
+            std::cerr << "A file with the same name already exists in the current path. Please choose a different name." << std::endl;
+            return;
+        }
+        parent += "/" + randomized;
+    }
+
+    hostPath = getHostPath(session);
+    for (const std::string& randomized : FilenameRandomizer::GetOrEncryptPath(getCustomPWD(session), names, session.filesystemPath)) {
+        hostPath /= randomized;
+        if (!makeHostDirectory(hostPath)) {
+            return;
+        }
+    }
+    std::cout << "Directory created successfully." << std::endl;
+}
+
+void processFileCreation(const CommandLine& line, const Session& session) {
+    const std::string& filename = line.arg(0);
+    std::string contents = line.restAfter(0);
+    // Drop the space separating the filename from the contents
+    if (!contents.empty() && contents[0] == ' ') {
+        contents.erase(0, 1);
+    }
+
+    if (filename.find('/') != std::string::npos) {
+        std::cout << "File name cannot contain '/'" << std::endl;
+        return;
+    }
+    if (!checkIfPersonalDirectory(session.userName, getCustomPWD(session), session.filesystemPath)) {
+        std::cout << "Forbidden" << std::endl;
+        return;
+    }
+
+    std::filesystem::path pathObj(filename);
+    std::string filenameStr = pathObj.filename().string();
+    if (!filenameStr.empty() && isValidFilename(filename)) {
+        createAndEncryptFile(filename, contents, session);
+    } else {
+        std::cerr << "Not a valid filename, try again." << std::endl;
+    }
+}
+
+void processAddUser(const CommandLine& line, const Session& session) {
+    const std::string& newUser = line.arg(0);
+
+    if (newUser.empty()) {
+        std::cerr << "Please enter a username" << std::endl;
+        return;
+    }
+    addUser(newUser, session.filesystemPath, false);
+}
+
+void processAddUsers(const CommandLine& line, const Session& session) {
+    const std::string& filesystemPath = session.filesystemPath;
+    const std::string& userFile = line.arg(0);
+
+    if (userFile.empty()) {
+        std::cerr << "Please enter a file with usernames" << std::endl;
+        return;
+    }
+    std::vector<std::string> userNames;
+    if (!readUserNames((fs::path(filesystemPath) / userFile).string(), userNames)) {
+        std::cerr << "Failed to open " << userFile << std::endl;
+        return;
+    }
+    size_t added = addUsers(userNames, filesystemPath);
+    std::cout << added << " of " << userNames.size() << " users added." << std::endl;
+}
+
+const std::unordered_map<std::string, Command>& sessionCommands() {
+    static const std::unordered_map<std::string, Command> commands = {
+        {"cd", {[](const CommandLine& line, Session& session) {
+                    std::string directoryName = line.argCount() > 0 ? line.arg(0) : "/";
+                    handleChangeDirectory(directoryName, session);
+                }, 0, 1, false, "cd <directory>"}},
+        {"pwd", {[](const CommandLine&, Session& session) { printDecryptedCurrentPath(session); },
+                 0, 0, false, "pwd"}},
+        {"ls", {[](const CommandLine&, Session& session) { listDirectoryContents(session); },
+                0, 0, false, "ls"}},
+        {"cat", {[](const CommandLine& line, Session& session) { processFileAccess(line, session); },
+                 1, 3, false, "cat <filename> [<offset> <length>]"}},
+        {"head", {[](const CommandLine& line, Session& session) { processFileHeadTail(line, session, false); },
+                  2, 2, false, "head <filename> <bytes>"}},
+        {"tail", {[](const CommandLine& line, Session& session) { processFileHeadTail(line, session, true); },
+                  2, 2, false, "tail <filename> <bytes>"}},
+        {"share", {[](const CommandLine& line, Session& session) { handleFileSharing(line, session); },
+                   2, 2, false, "share <filename> <username>"}},
+        {"mkdir", {[](const CommandLine& line, Session& session) {
+                       if (line.arg(0) == "-p" && line.argCount() == 2) {
+                           processCreateDirectoryTree(line.arg(1), session);
+                       } else if (line.argCount() == 1 && line.arg(0) != "-p") {
+                           processCreateDirectoryInUserSpace(line.arg(0), session);
+                       } else {
+                           std::cout << "Usage: mkdir [-p] <directory_name>" << std::endl;
+                       }
+                   }, 1, 2, false, "mkdir [-p] <directory_name>"}},
+        // The contents are the rest of the line and may contain spaces
+        {"mkfile", {[](const CommandLine& line, Session& session) { processFileCreation(line, session); },
+                    1, COMMAND_UNBOUNDED_ARGS, false, "mkfile <filename> <contents>"}},
+        {"adduser", {[](const CommandLine& line, Session& session) { processAddUser(line, session); },
+                     1, 1, true, "adduser <username>"}},
+        {"addusers", {[](const CommandLine& line, Session& session) { processAddUsers(line, session); },
+                      1, 1, true, "addusers <file>"}},
+    };
+    return commands;
+}
+
+Session createSession(std::string user_name, UserType user_type, std::vector<uint8_t> key, std::string filesystemPath) {
+  Session session{user_name, user_type, key, filesystemPath, {}, {}, {}};
+  if (user_type == user) {
+    std::string user_folder = FilenameRandomizer::GetRandomizedName("/filesystem/" + user_name, filesystemPath);
+    session.root.push_back(user_folder);
+  }
+  session.cwd = session.root;
+  return session;
+}
+
+CommandResult executeCommand(const CommandLine& line, Session& session) {
+  if (!line.words.empty() && line.words[0] == "exit") {
+    return CommandResult::exit;
+  }
+  const std::unordered_map<std::string, Command>& commands = sessionCommands();
+  auto command = line.words.empty() ? commands.end() : commands.find(line.words[0]);
+  if (command == commands.end() || (command->second.adminOnly && session.userType != admin)) {
+    std::cout << "Invalid Command" << std::endl;
+    return CommandResult::invalid;
+  }
+  if (line.argCount() < command->second.minArgs || line.argCount() > command->second.maxArgs) {
+    std::cout << "Usage: " << command->second.usage << std::endl;
+    return CommandResult::usage;
+  }
+
+  // Encryption and metadata errors abort the command, not the session
+  try {
+      command->second.handler(line, session);
+  } catch (const std::exception& e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return CommandResult::failed;
+  }
+  return CommandResult::ok;
+}
+
+int userFeatures(std::string user_name, UserType user_type, std::vector<uint8_t> key, std::string filesystemPath,
+                 std::istream& input, bool interactive) {
+  if (interactive) {
+    std::cout << "++++++++++++++++++++++++" << std::endl;
+    std::cout << "++| WELCOME TO EFS! |++" << std::endl;
+    std::cout << "++++++++++++++++++++++++" << std::endl;
+    std::cout << "\nEFS Commands Available: \n" << std::endl;
+
+    std::cout << "cd <directory> \n"
+            "pwd \n"
+            "ls  \n"
+            "cat <filename> [<offset> <length>] \n"
+            "head <filename> <bytes> \n"
+            "tail <filename> <bytes> \n"
+            "share <filename> <username> \n"
+            "mkdir [-p] <directory_name> \n"
+            "mkfile <filename> <contents> \n"
+            "exit \n";
+
+    if (user_type == admin) {
+      std::cout << "adduser <username>" << std::endl;
+      std::cout << "addusers <file>" << std::endl;
+    }
+    std::cout << "++++++++++++++++++++++++" << std::endl;
+  }
+
+  Session session = createSession(user_name, user_type, key, filesystemPath);
+  bool timing = commandTimingEnabled();
+  std::map<std::string, CommandStats> stats;
+  std::string input_feature;
+
+  for (;;) {
+    if (interactive) {
+      std::cout << user_name << " " << getPlaintextPWD(session) << "> ";
+    }
+    // A last line without a newline still runs, end of input is when nothing at all could be read
+    if (!getline(input, input_feature)) {
+        if (interactive) {
+          std::cout << "Ctrl+D detected." << std::endl;
+        }
+        break;
+    }
+
+    CommandLine line = parseCommandLine(input_feature);
+    if (!interactive && (line.words.empty() || line.words[0][0] == '#')) {
+      continue;
+    }
+    auto started = std::chrono::steady_clock::now();
+    CommandResult result = executeCommand(line, session);
+    if (result == CommandResult::exit) {
+      break;
+    }
+    if (timing && (result == CommandResult::ok || result == CommandResult::failed)) {
+      std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - started;
+      CommandStats& entry = stats[line.words[0]];
+      entry.calls++;
+      entry.total += elapsed;
+      entry.slowest = std::max(entry.slowest, elapsed);
+    }
+  }
+
+  printCommandStats(stats, std::cerr);
+  return 0;
+}
@@ -0,0 +1,398 @@
+#include "features/features_helpers.h"
+
+bool doesFileExist(const std::string& randomizedFilename) {
+    if (!fs::exists(randomizedFilename)) {
+        std::cout << "File does not exist" << std::endl;
+        return false;
+    }
+    fs::file_status status = fs::status(randomizedFilename);
+    if (status.type() == fs::file_type::directory) {
+        std::cerr << "File does not exist" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool doesUserExist(const std::string& username, const std::string& filesystemPath) {
+    if (UserRegistry::Instance(filesystemPath).Contains(username)) {
+        return true;
+    }
+    std::cout << "User " << username << " does not exist!" << std::endl;
+    return false;
+}
+
+std::string getRandomizedUserDirectory(const std::string& username, const std::string& filesystemPath) {
+    return FilenameRandomizer::GetRandomizedName("/filesystem/" + username, filesystemPath);
+}
+
+std::string getRandomizedSharedDirectory(const std::string& randomizedUserDirectory, const std::string& filesystemPath) {
+    return FilenameRandomizer::GetRandomizedName("/filesystem/" + randomizedUserDirectory + "/shared", filesystemPath);
+}
+
+void parseFileContents(std::ifstream& file, std::vector<std::string>& keys, std::vector<std::string>& usernames) {
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t pos = line.find(":");
+    if (pos != std::string::npos) {
+      std::string username = line.substr(0, pos);
+      std::string key = line.substr(pos + 1);
+      usernames.push_back(username);
+      keys.push_back(key);
+    }
+  }
+}
+
+void updateSharedFiles(std::vector<std::string> keys, std::vector<std::string> usernames, std::string filePath, std::string filesystemPath, std::vector<uint8_t> ownerKey) {
+    // Resolve every recipient's copy and key up front, then write the stubs in one batch
+    std::vector<std::string> sharedRandomizedFilenames = FilenameRandomizer::GetRandomizedNames(keys, filesystemPath);
+    std::vector<AccessGrant> grants;
+    for (size_t i = 0; i < keys.size(); i++) {
+        std::string key = keys[i];
+        int lastOccurence = key.find_last_of('/');
+        key.erase(lastOccurence + 1, key.length());
+
+        std::string shareUserPath = filesystemPath + key + sharedRandomizedFilenames[i];
+        if (Encryption::isAccessStub(shareUserPath)) {
+            continue;
+        }
+        std::vector<uint8_t> shareKey = UserRegistry::Instance(filesystemPath).GetKey(usernames[i]);
+        if (shareKey.empty()) {
+            continue;
+        }
+        grants.push_back({shareUserPath, shareKey});
+    }
+
+    if (!grants.empty()) {
+        Encryption::grantAccess(filePath, ownerKey, grants);
+    }
+}
+
+void checkIfShared(std::string randomizedFilename, std::string filePath, std::string filesystemPath, std::vector<uint8_t> ownerKey) {
+  // Construct the filepath to the shared file directory
+  std::string filepath = filesystemPath + "/shared/" + randomizedFilename;
+
+  if (fs::exists(filepath)) {
+    std::ifstream file(filepath);
+    std::vector<std::string> keys, usernames;
+    parseFileContents(file, keys, usernames);
+    file.close();
+
+    updateSharedFiles(keys, usernames, filePath, filesystemPath, ownerKey);
+  }
+}
+
+bool checkSpecificFile(const std::string& filepath, const std::string& sharedUsername, const std::string& valueToCheck) {
+    if (fs::exists(filepath)) {
+        std::ifstream file(filepath);
+        std::string line;
+        while (getline(file, line)) {
+            size_t pos = line.find(":");
+            if (pos != std::string::npos) {
+                std::string user = line.substr(0, pos);
+                std::string key = line.substr(pos + 1);
+                if (user == sharedUsername && key == valueToCheck) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool checkFileForKey(const fs::path& filePath, const std::string& valueToCheck) {
+    std::ifstream file(filePath);
+    std::string line;
+    while (getline(file, line)) {
+        size_t pos = line.find(":");
+        if (pos != std::string::npos) {
+            std::string key = line.substr(pos + 1);
+            if (key == valueToCheck) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool isFileSharedWithUser(std::string filename, const Session& session, std::string sharedUsername) {
+    const std::string& filesystemPath = session.filesystemPath;
+    const std::string& username = session.userName;
+    // Randomize filenames and directories for security or privacy reasons
+    std::string randomizedFilename = FilenameRandomizer::GetRandomizedName(getCustomPWD(session) + "/" + filename, filesystemPath);
+    std::string randomizedUserDirectory = FilenameRandomizer::GetRandomizedName("/filesystem/" + sharedUsername, filesystemPath);
+    std::string randomizedSharedDirectory = FilenameRandomizer::GetRandomizedName("/filesystem/" + randomizedUserDirectory + "/shared", filesystemPath);
+
+    // Construct the value to check for in the shared files
+    std::string valueToCheck = "/filesystem/" + randomizedUserDirectory + "/" + randomizedSharedDirectory + "/" + username + "-" + filename;
+
+    // Iterate through each file in the shared files directory to find a match
+    std::string filepath = filesystemPath + "/shared/";
+    for (const auto& entry : fs::directory_iterator(filepath)) {
+        if (fs::is_regular_file(entry)) {
+            if (checkFileForKey(entry.path(), valueToCheck)) {
+                return true;
+            }
+        }
+    }
+    if (checkSpecificFile(filepath, sharedUsername, valueToCheck)) {
+        return true;
+    }
+    return false;
+}
+
+std::string getEncFilename(std::string inputFilename, std::string inputPath, std::string filesystemPath, bool isMkdir) {
+  std::string parentPath = inputPath.substr(0, inputPath.find_last_of('/'));
+  for (const ChildEntry& child : FilenameRandomizer::ListChildren(parentPath, filesystemPath)) {
+    if (child.plaintext_name != inputFilename) {
+      continue;
+    }
+    // Return same path if a file with the same name exists
+    if (child.type == EntryType::File) {
+      if (!isMkdir)
+        return child.randomized_name;
+      else {
+        std::cerr << "A file with the same name already exists in the current path. Please choose a different name." << std::endl;
+        return "";
+      }
+    }
+    else if (child.type == EntryType::Directory) {
+      std::cerr << "A directory with the same name already exists in the current path. Please choose a different name." << std::endl;
+      return "";
+    }
+  }
+  // Another session may have created the same entry since the check above
+  return FilenameRandomizer::GetOrEncryptFilename(inputPath, filesystemPath);
+}
+
+bool makeHostDirectory(const fs::path& hostPath) {
+  if (::mkdir(hostPath.c_str(), 0777) == 0) {
+    return true;
+  }
+  int error = errno;
+  if (error == EEXIST && fs::is_directory(hostPath)) {
+    return true;
+  }
+  std::cerr << "Failed to create directory: " << std::strerror(error) << std::endl;
+  return false;
+}
+
+void createAndEncryptFile(std::string filename, std::string contents, const Session& session) {
+  const std::string& filesystemPath = session.filesystemPath;
+  // Ensure the operation is within the user's personal directory
+  if (!checkIfPersonalDirectory(session.userName, getCustomPWD(session), filesystemPath)) {
+    std::cout << "Forbidden " << std::endl;
+    return;
+  }
+
+  // Ensure the filename does not contain illegal characters ("/")
+  if (filename.find('/') != std::string::npos) {
+    std::cout << "File name cannot contain '/'" << std::endl;
+    return;
+  }
+
+  // Construct the full path for the file
+  std::string path = getCustomPWD(session) + "/" + filename;
+  // Obtain an encrypted name for the file, to maintain security or privacy
+  std::string encryptedName = getEncFilename(filename, path, filesystemPath, false);
+  if (!encryptedName.empty()) {
+    // Encrypt and save the file with the encrypted name
+    std::string filePath = getHostPath(session, encryptedName).string();
+    Encryption::encryptFile(filePath, contents, session.key);
+    // Check if the file is intended to be shared and handle accordingly
+    checkIfShared(encryptedName, filePath, filesystemPath, session.key);
+    std::cout << "File created and encrypted successfully!" << std::endl;
+  }
+}
+
+std::vector<std::string> processAndDecryptPath(std::string path, const std::string& filesystemPath) {
+    const std::string delimiter = "/";
+    std::vector<std::string> filenames;
+    size_t pos = 0;
+
+    while ((pos = path.find(delimiter)) != std::string::npos) {
+        std::string name = path.substr(0, pos);
+        if (name == "filesystem") {
+            // Add 'filesystem' directly without decryption
+            filenames.push_back(name);
+        } else {
+            // Decrypt the name and add it to the filenames vector
+            std::string decrypted = FilenameRandomizer::GetFilename(name, filesystemPath);
+            filenames.push_back(decrypted);
+        }
+        // Prepare for the next iteration
+        path.erase(0, pos + delimiter.length());
+    }
+
+    // Handle the case where there is a remaining part of the path after the last delimiter
+    if (!path.empty()) {
+        if (path == "filesystem") {
+            filenames.push_back(path);
+        } else {
+            std::string decrypted = FilenameRandomizer::GetFilename(path, filesystemPath);
+            filenames.push_back(decrypted);
+        }
+    }
+
+    return filenames;
+}
+
+std::string decryptFilePath(std::string path, const std::string& filesystemPath) {
+    // Normalize the path by removing a leading "/"
+    if (!path.empty() && path[0] == '/') {
+        path = path.substr(1);
+    }
+
+    std::vector<std::string> decryptedFilenames = processAndDecryptPath(path, filesystemPath);
+
+    // Reconstruct the decrypted file path
+    std::string decryptedFilePath = "/";
+    for (const auto& name : decryptedFilenames) {
+        decryptedFilePath += name + "/";
+    }
+    decryptedFilePath.pop_back();
+
+    return decryptedFilePath;
+}
+
+std::string getPlaintextPWD(const Session& session) {
+    std::unordered_map<std::string, std::string>& cache = session.paths.plaintextPaths;
+    std::string pwd = getCustomPWD(session);
+    auto hit = cache.find(pwd);
+    if (hit != cache.end()) {
+        return hit->second;
+    }
+    if (cache.size() >= SESSION_PATH_CACHE_ENTRIES) {
+        cache.clear();
+    }
+
+    size_t known = session.cwd.size();
+    size_t prefixLength = pwd.size();
+    std::string plaintext = "/filesystem";
+    while (known > 0) {
+        prefixLength -= session.cwd[known - 1].size() + 1;
+        known--;
+        hit = cache.find(pwd.substr(0, prefixLength));
+        if (hit != cache.end()) {
+            plaintext = hit->second;
+            break;
+        }
+    }
+    for (size_t i = known; i < session.cwd.size(); i++) {
+        prefixLength += session.cwd[i].size() + 1;
+        plaintext += "/" + FilenameRandomizer::GetFilename(session.cwd[i], session.filesystemPath);
+        cache[pwd.substr(0, prefixLength)] = plaintext;
+    }
+    return plaintext;
+}
+
+std::string getCachedRandomizedName(const Session& session, const std::string& key) {
+    std::unordered_map<std::string, std::string>& cache = session.paths.randomizedNames;
+    auto hit = cache.find(key);
+    if (hit != cache.end()) {
+        return hit->second;
+    }
+    std::string randomized = FilenameRandomizer::GetRandomizedName(key, session.filesystemPath);
+    if (!randomized.empty()) {
+        if (cache.size() >= SESSION_PATH_CACHE_ENTRIES) {
+            cache.clear();
+        }
+        cache.emplace(key, randomized);
+    }
+    return randomized;
+}
+
+std::string getEncryptedFilePath(std::string path, const Session& session) {
+    if (path == "." || path == "./") {
+        return path;
+    }
+    std::string pwd = getCustomPWD(session);
+    size_t pos = 0;
+    const std::string delimiter = "/";
+    std::vector<std::string> filenames;
+    std::string keyPath = pwd;
+
+    while ((pos = path.find(delimiter)) != std::string::npos) {
+        std::string name = path.substr(0, pos);
+        if (name == ".") {
+            filenames.push_back(name);
+        } else if (name == "..") {
+            int lastOccurrence = keyPath.find_last_of('/');
+            keyPath.erase(lastOccurrence, keyPath.length());
+            filenames.push_back(name);
+        } else {
+            std::string randomized = getCachedRandomizedName(session, keyPath + "/" + name);
+            filenames.push_back(randomized);
+            keyPath += "/" + randomized;
+        }
+        path.erase(0, pos + delimiter.length());
+    }
+
+    if (path == ".." || path == ".") {
+        filenames.push_back(path);
+    } else {
+        std::string randomizedName = getCachedRandomizedName(session, keyPath + "/" + path);
+        if (!randomizedName.empty()) {
+            filenames.push_back(randomizedName);
+        }
+    }
+
+    std::string encryptedFilePath;
+    for (const auto& name : filenames) {
+        encryptedFilePath += name + "/";
+    }
+
+    if (!encryptedFilePath.empty() && encryptedFilePath.back() == '/') {
+        encryptedFilePath.pop_back();
+    }
+    return encryptedFilePath;
+}
+
+bool resolveReadableFile(const std::string& filename, const Session& session, std::string& encryptedPath, std::vector<uint8_t>& fileKey) {
+    const std::string& filesystemPath = session.filesystemPath;
+    if (filename.empty()) {
+        std::cout << "File name not provided" << std::endl;
+        return false;
+    }
+    if (filename.find('/') != std::string::npos) {
+        std::cout << "File name cannot contain '/'" << std::endl;
+        return false;
+    }
+
+    std::string path = getCustomPWD(session) + "/" + filename;
+    std::string encryptedName = FilenameRandomizer::GetRandomizedName(path, filesystemPath);
+    if (encryptedName.empty()) {
+        std::cerr << "File does not exist" << std::endl;
+        return false;
+    }
+    encryptedPath = getHostPath(session, encryptedName).string();
+
+    if (!fs::exists(encryptedPath)) {
+        std::cerr << "File does not exist" << std::endl;
+        return false;
+    }
+    if (fs::is_directory(fs::status(encryptedPath))) {
+        std::cerr << "File does not exist" << std::endl;
+        return false;
+    }
+
+    if (session.userType == UserType::admin) {
+        std::string pwd = getPlaintextPWD(session);
+        std::string userForKey = getUsernameFromPath(pwd);
+        fileKey = UserRegistry::Instance(filesystemPath).GetKey(userForKey);
+    } else {
+        fileKey = session.key;
+    }
+    return true;
+}
+
+bool parseByteCount(const std::string& token, uint64_t& value) {
+    if (token.empty() || token.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    try {
+        value = std::stoull(token);
+    } catch (const std::out_of_range&) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,14 @@
+#include "features/session.h"
+
+std::string getCustomPWD(const Session& session) {
+    std::string pwd = "/filesystem";
+    for (const std::string& component : session.cwd) {
+        pwd += "/" + component;
+    }
+    return pwd;
+}
+
+fs::path getHostPath(const Session& session, const std::string& name) {
+    fs::path path = fs::path(session.filesystemPath + getCustomPWD(session));
+    return name.empty() ? path : path / name;
+}
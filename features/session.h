@@ -0,0 +1,51 @@
+/*
+* Session: Everything one logged-in user's commands work against. The working directory is kept here as
+* randomized path components below /filesystem instead of in the process-wide current directory, so
+* several sessions can share a process without moving each other around.
+*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "authentication/authentication.h"
+
+namespace fs = std::filesystem;
+
+#define SESSION_PATH_CACHE_ENTRIES 65536 // per map, which starts over once it is full
+
+// Paths the session has resolved. Metadata is only ever added to, so a name that resolved once keeps resolving
+// to the same thing; misses aren't kept, the entry may still be created
+struct PathCache {
+    // Randomized path as from getCustomPWD, and every prefix of it, to its plaintext e.g. "/filesystem/bob/personal"
+    std::unordered_map<std::string, std::string> plaintextPaths;
+    // Metadata key, a randomized parent path plus "/" and a plaintext name, to the randomized name
+    std::unordered_map<std::string, std::string> randomizedNames;
+};
+
+struct Session {
+    std::string userName;
+    UserType userType;
+    std::vector<uint8_t> key;
+    // Host directory holding filesystem/, common/, shared/ and key/
+    std::string filesystemPath;
+    // Randomized components below /filesystem: the directory the session can't leave, and where it is now
+    std::vector<std::string> root;
+    std::vector<std::string> cwd;
+    // Filled in by lookups, which only get to see a const Session
+    mutable PathCache paths;
+};
+
+/// The current directory in metadata form, e.g. "/filesystem/<randomized user>/<randomized dir>"
+std::string getCustomPWD(const Session& session);
+
+/// Where an entry of the current directory lives on the host
+/// \param name    A randomized name, or a relative path of them; empty for the directory itself
+fs::path getHostPath(const Session& session, const std::string& name = "");
+
+#endif // SESSION_H
@@ -0,0 +1,57 @@
+/*
+* Thread Pool: Fixed set of worker threads used to spread independent work (e.g. file chunks) across cores.
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const;
+
+    template <typename Task>
+    auto submit(Task task) -> std::future<decltype(task())>;
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_ = false;
+
+    // Set on pool threads so nested parallelFor calls run inline instead of waiting on their own pool
+    static thread_local bool isWorkerThread_;
+};
+
+/// Queue a task; exceptions it throws surface from the returned future's get()
+template <typename Task>
+auto ThreadPool::submit(Task task) -> std::future<decltype(task())> {
+    auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+    std::future<decltype(task())> result = packaged->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace([packaged]() { (*packaged)(); });
+    }
+    condition_.notify_one();
+    return result;
+}
+
+#endif // THREAD_POOL_H
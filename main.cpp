@@ -1,57 +1,126 @@
 #include <iostream>
 #include <fstream>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <filesystem>
 
+#include "secfs.h"
 #include "authentication/authentication.h"
-#include "features/features.h"
 #include "helpers/helper_functions.h"
+#include "server/session_server.h"
 
 namespace fs = std::filesystem;
 
+/// Log in with a keyfile and run a session, printing to stdout
+/// \param keyFileName       The keyfile name, looked up in key/private_keys
+/// \param filesystemPath    The filesystem root
+/// \param input             Where commands are read from
+/// \param interactive       false for batch mode: no login message, banner or prompts
+/// \return                  Process exit code
+int runSession(const std::string& keyFileName, const std::string& filesystemPath,
+               std::istream& input = std::cin, bool interactive = true) {
+    std::string userName = getTypeOfUser(keyFileName, interactive);
+    UserType userType;
+    if(userName == "admin")
+        userType = UserType::admin;
+    else
+        userType = UserType::user;
+
+    FilenameRandomizer::LoadMetadata(filesystemPath);
+    std::vector<uint8_t> userKey = UserRegistry::Instance(filesystemPath).GetKey(userName);
+    if (userType == UserType::admin && KeyPool::ConfiguredSize() > 0) {
+        // Refill while the admin works, so the next adduser doesn't wait on key generation
+        KeyPool::Instance(filesystemPath).Open(userKey);
+        KeyPool::Instance(filesystemPath).StartRefill(KeyPool::ConfiguredSize());
+    }
+    userFeatures(userName, userType, userKey, filesystemPath, input, interactive);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     std::string filesystemPath = fs::current_path();
 
     if(fs::exists("filesystem")) {
-        if(argc != 2) {
+        // Long-running server for sessions: ./fileserver --serve
+        if (argc == 2 && std::string(argv[1]) == "--serve") {
+            return SessionServer::serve(filesystemPath, [&filesystemPath](const std::string& keyFileName,
+                                                                          bool interactive) {
+                return runSession(keyFileName, filesystemPath, std::cin, interactive);
+            });
+        }
+        // Batch mode: ./fileserver keyfile --no-prompt reads commands from stdin,
+        // ./fileserver keyfile --batch <script> from a file
+        bool isNoPrompt = argc == 3 && std::string(argv[2]) == SESSION_NO_PROMPT;
+        bool isBatch = argc == 4 && std::string(argv[2]) == "--batch";
+        if (isNoPrompt || isBatch) {
+            int inputFd = isBatch ? ::open(argv[3], O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+            if (inputFd < 0) {
+                std::cerr << "Failed to open " << argv[3] << std::endl;
+                return 1;
+            }
+            // A server reads the script from the connection, relayed from here like stdin
+            int exitCode;
+            bool proxied = SessionServer::proxySession(argv[1], false, inputFd, exitCode);
+            if (isBatch) {
+                ::close(inputFd);
+            }
+            if (proxied) {
+                return exitCode;
+            }
+            std::ifstream script;
+            if (isBatch) {
+                script.open(argv[3]);
+            }
+            std::istream& input = isBatch ? static_cast<std::istream&>(script) : std::cin;
+            return runSession(argv[1], filesystemPath, input, false);
+        }
+        // Bulk provisioning without a session: ./fileserver admin_keyfile addusers <file>
+        bool isAddUsers = argc == 4 && std::string(argv[2]) == "addusers";
+        if(argc != 2 && !isAddUsers) {
             std::cout << "Invalid keyfile\n" << std::endl;
             return 1;
         } 
+        else if (!isAddUsers) {
+            int exitCode;
+            if (SessionServer::proxySession(argv[1], true, STDIN_FILENO, exitCode)) {
+                return exitCode;
+            }
+            return runSession(argv[1], filesystemPath);
+        }
         else {
             std::string keyFileName = argv[1];
             std::string userName = getTypeOfUser(keyFileName);
-            UserType userType;
-            if(userName == "admin")
-                userType = UserType::admin;
-            else
-                userType = UserType::user;
+            if (userName != "admin") {
+                std::cout << "Forbidden" << std::endl;
+                return 1;
+            }
 
-            userFeatures(userName, userType, readEncKeyFromMetadata(userName, ""), filesystemPath);
+            FilenameRandomizer::LoadMetadata(filesystemPath);
+            if (KeyPool::ConfiguredSize() > 0) {
+                KeyPool::Instance(filesystemPath).Open(UserRegistry::Instance(filesystemPath).GetKey(userName));
+            }
+            std::vector<std::string> userNames;
+            if (!readUserNames(argv[3], userNames)) {
+                std::cerr << "Failed to open " << argv[3] << std::endl;
+                return 1;
+            }
+            size_t added = addUsers(userNames, filesystemPath);
+            std::cout << added << " of " << userNames.size() << " users added." << std::endl;
+            return added == userNames.size() ? 0 : 1;
         }
     } 
     else {
-        if(
-            !createDirectory("key") ||
-            !createDirectory("key/public_keys") ||
-            !createDirectory("key/private_keys") ||
-            !createDirectory("common") ||
-            !createDirectory("shared") ||
-            !createDirectory("filesystem")) {
+        if (!initializeFilesystem(filesystemPath)) {
             return 1;
         }
 
-    std::string metadataPath = "common/structure.json";
-    std::ofstream metadataFile(metadataPath);
-    if (metadataFile) {
-        metadataFile << "{\"test\":\"123\"}";
-        metadataFile.close();
-    } else {
-        std::cerr << "Error creating structure.json\n" << std::endl;
-        return 1;
+        std::string userName = "admin";
+        std::vector<uint8_t> adminKey = UserRegistry::Instance(filesystemPath).GetKey(userName);
+        if (KeyPool::ConfiguredSize() > 0) {
+            KeyPool::Instance(filesystemPath).Open(adminKey);
+            KeyPool::Instance(filesystemPath).StartRefill(KeyPool::ConfiguredSize());
+        }
+        userFeatures(userName, UserType::admin, adminKey, filesystemPath);
     }
-
-    std::string userName = "admin";
-    addUser(userName, filesystemPath, true);
-    userFeatures(userName, UserType::admin, readEncKeyFromMetadata(userName, ""), filesystemPath);
-  }
 }
@@ -0,0 +1,33 @@
+#include "secfs.h"
+
+bool initializeFilesystem(const std::string& filesystemPath) {
+    fs::path root = filesystemPath;
+    for (const char* directory : {"key", "key/public_keys", "key/private_keys", "common", "shared", "filesystem"}) {
+        if (!createDirectory(root / directory)) {
+            return false;
+        }
+    }
+
+    try {
+        MetadataStore::Write((root / "common/structure.bin").string(), {});
+    } catch (const std::exception& e) {
+        std::cerr << "Error creating structure.bin\n" << std::endl;
+        return false;
+    }
+
+    FilenameRandomizer::LoadMetadata(filesystemPath);
+    addUser("admin", filesystemPath, true);
+    return true;
+}
+
+bool openSession(const std::string& keyFileName, const std::string& filesystemPath, Session& session) {
+    std::string userName;
+    if (!resolveKeyfileUser(keyFileName, userName)) {
+        return false;
+    }
+    UserType userType = userName == "admin" ? UserType::admin : UserType::user;
+
+    FilenameRandomizer::LoadMetadata(filesystemPath);
+    session = createSession(userName, userType, UserRegistry::Instance(filesystemPath).GetKey(userName), filesystemPath);
+    return true;
+}
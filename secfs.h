@@ -0,0 +1,28 @@
+/*
+* SecFS: The engine's interface for programs linking secfs_core, such as benchmarks, daemons and embedders,
+* that want the filesystem without the fileserver's interactive loop. A filesystem is initialized once, a
+* keyfile opens a session on it, and session lines run one at a time through the same command table.
+*/
+
+#ifndef SECFS_H
+#define SECFS_H
+
+#include <string>
+
+#include "features/command_table.h"
+#include "features/features.h"
+#include "features/session.h"
+
+/// Create an empty filesystem with its admin, like the first start of ./fileserver
+/// \param filesystemPath    The directory to create it in; key/, common/, shared/ and filesystem/ go below it
+/// \return                  false if a directory or the metadata couldn't be created
+bool initializeFilesystem(const std::string& filesystemPath);
+
+/// Log in with a keyfile without printing anything, loading the metadata and the user's key
+/// \param keyFileName       The keyfile name, looked up in key/private_keys
+/// \param filesystemPath    The filesystem root
+/// \param session           Set to a session at the user's root
+/// \return                  false if the keyfile doesn't exist or isn't valid
+bool openSession(const std::string& keyFileName, const std::string& filesystemPath, Session& session);
+
+#endif // SECFS_H
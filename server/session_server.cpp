@@ -0,0 +1,218 @@
+#include "server/session_server.h"
+
+/// Accept connections until the listening socket fails, running each session in a forked child
+/// \param filesystemPath    The filesystem root; must be the working directory
+/// \param runSession        Runs one session in the child, reading commands from stdin; interactive unless the
+///                          client asked for SESSION_NO_PROMPT
+/// \return                  Process exit code
+int SessionServer::serve(const std::string& filesystemPath, const SessionRunner& runSession) {
+    int existing = connectToServer();
+    if (existing >= 0) {
+        ::close(existing);
+        std::cerr << "A server is already listening on " << SESSION_SOCKET_PATH << std::endl;
+        return 1;
+    }
+    // Nobody answered, so any socket file left behind belongs to a server that is gone
+    ::unlink(SESSION_SOCKET_PATH);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, SESSION_SOCKET_PATH, sizeof(address.sun_path) - 1);
+    // Only the owner of the filesystem may connect, same as for reading the keyfiles directly
+    mode_t previousMask = ::umask(0077);
+    bool listening = listener >= 0 &&
+                     ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+                     ::listen(listener, SOMAXCONN) == 0;
+    ::umask(previousMask);
+    if (!listening) {
+        std::cerr << "Failed to listen on " << SESSION_SOCKET_PATH << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return 1;
+    }
+
+    // Everything a session would otherwise load at startup, inherited by every child
+    MetadataIndex::Instance(filesystemPath).RefreshIfChanged();
+    UserRegistry::Instance(filesystemPath).Load();
+    Encryption::warmUp();
+
+    // Sessions report through their connection, nobody waits for them
+    std::signal(SIGCHLD, SIG_IGN);
+    std::cout << "Serving sessions on " << SESSION_SOCKET_PATH << std::endl;
+
+    for (;;) {
+        int connection = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        // Catch up with other sessions' changes once here rather than in every child
+        try {
+            MetadataIndex::Instance(filesystemPath).RefreshIfChanged();
+            UserRegistry::Instance(filesystemPath).RefreshIfChanged();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            ::close(listener);
+            std::signal(SIGCHLD, SIG_DFL);
+            std::string keyFileName;
+            std::string userName;
+            if (!readLine(connection, keyFileName)) {
+                ::_exit(1);
+            }
+            bool interactive = true;
+            size_t separator = keyFileName.find('\t');
+            if (separator != std::string::npos) {
+                interactive = keyFileName.compare(separator + 1, std::string::npos, SESSION_NO_PROMPT) != 0;
+                keyFileName.erase(separator);
+            }
+            // Answered before the session starts so the client can exit with the same status as a local login
+            char status = resolveKeyfileUser(keyFileName, userName) ? SESSION_ACCEPTED : SESSION_REJECTED;
+            if (!writeAll(connection, &status, 1) || status == SESSION_REJECTED) {
+                ::_exit(1);
+            }
+            if (::dup2(connection, STDIN_FILENO) < 0 || ::dup2(connection, STDOUT_FILENO) < 0 ||
+                ::dup2(connection, STDERR_FILENO) < 0) {
+                ::_exit(1);
+            }
+            ::close(connection);
+            int exitCode = runSession(keyFileName, interactive);
+            // The refill thread an admin session starts is the child's own; stop it between two entries
+            if (KeyPool::ConfiguredSize() > 0) {
+                KeyPool::Instance(filesystemPath).Stop();
+            }
+            // _exit() rather than return or exit(): the child must not fall back into the accept loop, nor run
+            // the static destructors of singletons it inherited from the server
+            std::cout.flush();
+            std::cerr.flush();
+            ::_exit(exitCode);
+        }
+        if (pid < 0) {
+            std::cerr << "fork failed: " << std::strerror(errno) << std::endl;
+        }
+        ::close(connection);
+    }
+    ::close(listener);
+    ::unlink(SESSION_SOCKET_PATH);
+    return 1;
+}
+
+/// Run a session through the server, relaying input to it and its output to stdout
+/// \param interactive    false asks for a batch session without banner and prompts
+/// \param inputFd        Where the commands come from, stdin or an opened script
+/// \param exitCode       Set to 0 once the server ends the session, 1 for an invalid keyfile or a broken connection
+/// \return               false if no server is listening, the caller then runs the session itself
+bool SessionServer::proxySession(const std::string& keyFileName, bool interactive, int inputFd, int& exitCode) {
+    int connection = connectToServer();
+    if (connection < 0) {
+        return false;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::string request = keyFileName + (interactive ? "" : "\t" SESSION_NO_PROMPT) + "\n";
+    exitCode = 1;
+    char status = SESSION_REJECTED;
+    if (!writeAll(connection, request.data(), request.size()) || ::recv(connection, &status, 1, MSG_WAITALL) != 1) {
+        std::cerr << "Lost connection to the server" << std::endl;
+        ::close(connection);
+        return true;
+    }
+    if (status != SESSION_ACCEPTED) {
+        std::cerr << "Invalid keyfile" << std::endl;
+        ::close(connection);
+        return true;
+    }
+
+    char buffer[SESSION_RELAY_BUFFER_SIZE];
+    pollfd fds[2] = {{inputFd, POLLIN, 0}, {connection, POLLIN, 0}};
+    for (;;) {
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = ::read(inputFd, buffer, sizeof(buffer));
+            if (n <= 0 || !writeAll(connection, buffer, n)) {
+                // End of input: the session sees EOF on its stdin, same as Ctrl+D
+                ::shutdown(connection, SHUT_WR);
+                fds[0].fd = -1;
+            }
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = ::read(connection, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                exitCode = n == 0 ? 0 : 1;
+                break;
+            }
+            if (!writeAll(STDOUT_FILENO, buffer, n)) {
+                break;
+            }
+        }
+    }
+    ::close(connection);
+    return true;
+}
+
+/// \return A connected socket, or -1 if no server is listening
+int SessionServer::connectToServer() {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, SESSION_SOCKET_PATH, sizeof(address.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read byte by byte: anything past the newline is the session's input and has to stay in the socket
+bool SessionServer::readLine(int fd, std::string& line) {
+    char c;
+    while (line.size() <= SESSION_KEYFILE_MAX_LENGTH) {
+        ssize_t n = ::read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        if (c == '\n') {
+            return true;
+        }
+        line.push_back(c);
+    }
+    return false;
+}
+
+bool SessionServer::writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = ::write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+/*
+* Session Server: Serves login sessions over a Unix domain socket so they don't pay for process startup.
+* `./fileserver --serve` loads metadata, the user registry and the cipher once, then forks a child per
+* connection. Each child inherits that warm state and runs an ordinary session with the connection as its
+* stdin, stdout and stderr, which is what the session code reads commands from and prints to.
+* `./fileserver <keyfile>` forwards to the server when one is listening and runs the session itself otherwise.
+*
+* Protocol: the client sends "<keyfile>\n", or "<keyfile>\t--no-prompt\n" for a batch session, and the server
+* answers with one byte, SESSION_ACCEPTED or SESSION_REJECTED for an invalid keyfile. After that the client
+* relays its input, the server relays the session's output and closes the connection when the session ends.
+*/
+
+#ifndef SESSION_SERVER_H
+#define SESSION_SERVER_H
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "authentication/authentication.h"
+#include "authentication/user_registry.h"
+#include "encryption/encryption.h"
+#include "encryption/metadata_index.h"
+
+#define SESSION_SOCKET_PATH "common/fileserver.sock" // relative to the filesystem root
+#define SESSION_KEYFILE_MAX_LENGTH 256 //bytes
+#define SESSION_RELAY_BUFFER_SIZE (64 * 1024) //bytes
+#define SESSION_ACCEPTED '+'
+#define SESSION_REJECTED '-'
+#define SESSION_NO_PROMPT "--no-prompt"
+
+class SessionServer {
+public:
+    using SessionRunner = std::function<int(const std::string& keyFileName, bool interactive)>;
+
+    static int serve(const std::string& filesystemPath, const SessionRunner& runSession);
+    static bool proxySession(const std::string& keyFileName, bool interactive, int inputFd, int& exitCode);
+
+private:
+    static int connectToServer();
+    static bool readLine(int fd, std::string& line);
+    static bool writeAll(int fd, const char* data, size_t length);
+};
+
+#endif // SESSION_SERVER_H
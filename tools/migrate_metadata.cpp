@@ -0,0 +1,44 @@
+/*
+* One-time migration of common/structure.json into the binary metadata store (common/structure.bin).
+* Run from (or pass) the directory that holds the filesystem, key and common folders.
+*/
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "encryption/metadata_lock.h"
+#include "encryption/metadata_store.h"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char *argv[]) {
+    if (argc > 2) {
+        std::cerr << "Usage: " << argv[0] << " [filesystem_root]" << std::endl;
+        return 1;
+    }
+
+    fs::path root = argc == 2 ? fs::path(argv[1]) : fs::current_path();
+    fs::path jsonPath = root / "common" / "structure.json";
+    fs::path storePath = root / "common" / "structure.bin";
+
+    if (!fs::exists(jsonPath) && !fs::exists(storePath)) {
+        std::cerr << "No metadata found at " << jsonPath.string() << std::endl;
+        return 1;
+    }
+
+    try {
+        // A running server migrates on load as well; whoever gets the lock first does it
+        MetadataLock lock((root / "common" / "structure.lock").string());
+        if (fs::exists(storePath)) {
+            std::cout << storePath.string() << " already exists, nothing to migrate" << std::endl;
+            return 0;
+        }
+        size_t migrated = MetadataStore::MigrateFromJson(jsonPath.string(), storePath.string());
+        std::cout << "Migrated " << migrated << " entries to " << storePath.string() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Migration failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
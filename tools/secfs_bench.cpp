@@ -0,0 +1,351 @@
+/*
+* Microbenchmarks for the encrypted filesystem, reported as JSON on stdout so runs can be compared over time.
+* Builds a scratch filesystem in a temporary directory (or --workdir), runs every benchmark whose name contains
+* the --filter text and removes the scratch directory again. Progress goes to stderr.
+*
+* Every benchmark times each operation on its own and reports the count, throughput (ops/s and, where data
+* is moved, bytes/s) and the mean, p50, p99 and max latency in microseconds. --quick runs fewer iterations and
+* skips the largest inputs, for a smoke run.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "authentication/authentication.h"
+#include "encryption/encryption.h"
+#include "encryption/metadata_store.h"
+#include "encryption/randomizer_function.h"
+#include "helpers/helper_functions.h"
+#include "helpers/json.hpp"
+#include "secfs.h"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+#define BENCH_PEER_COUNT 8
+#define BENCH_FILE_CONTENT_SIZE 1024 //bytes, for mkfile and share
+#define BENCH_METADATA_FANOUT 1000 // entries per directory in the metadata benchmarks
+
+struct BenchOptions {
+    bool quick = false;
+    std::string filter;
+    std::string outputPath;
+    fs::path workdir;
+};
+
+// Swallows what the feature functions print while they are being timed
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+NullBuffer nullBuffer;
+std::ostream nullStream(&nullBuffer);
+
+/**
+ * Nearest-rank percentile of sorted samples.
+ */
+double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+/**
+ * Runs one benchmark and appends its result to the report, unless the filter excludes it.
+ *
+ * @param name Benchmark name, the unit --filter matches against.
+ * @param params What the benchmark was run with, copied into the result.
+ * @param iterations How many operations to time.
+ * @param bytesPerOp Payload of one operation, 0 if it doesn't move data.
+ * @param operation Called with the iteration number, timed on its own.
+ */
+void runBenchmark(const BenchOptions& options, json& results, const std::string& name, const json& params,
+                  size_t iterations, uint64_t bytesPerOp, const std::function<void(size_t)>& operation) {
+    if (name.find(options.filter) == std::string::npos) {
+        return;
+    }
+    std::cerr << "bench: " << name << " " << params.dump() << " x" << iterations << std::endl;
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    std::streambuf* out = std::cout.rdbuf(&nullBuffer);
+    auto started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        operation(i);
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+    double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout.rdbuf(out);
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    json result = {
+        {"name", name},
+        {"params", params},
+        {"iterations", iterations},
+        {"total_s", totalSeconds},
+        {"ops_per_s", iterations / totalSeconds},
+        {"mean_us", sum / samples.size()},
+        {"p50_us", percentile(samples, 0.50)},
+        {"p99_us", percentile(samples, 0.99)},
+        {"max_us", samples.back()},
+    };
+    if (bytesPerOp > 0) {
+        result["bytes_per_s"] = bytesPerOp * iterations / totalSeconds;
+    }
+    results.push_back(result);
+}
+
+std::string randomName(std::mt19937_64& generator) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::uniform_int_distribution<size_t> pick(0, sizeof(alphabet) - 2);
+    std::string name(10, ' ');
+    for (char& c : name) {
+        c = alphabet[pick(generator)];
+    }
+    return name;
+}
+
+/**
+ * Encrypting and decrypting whole files of increasing size.
+ */
+void benchEncryption(const BenchOptions& options, json& results) {
+    std::vector<uint64_t> sizes = {1024, 64 * 1024, 1024 * 1024};
+    if (!options.quick) {
+        sizes.push_back(16 * 1024 * 1024);
+    }
+    uint64_t bytesPerSize = options.quick ? 8 * 1024 * 1024 : 128 * 1024 * 1024;
+
+    std::vector<uint8_t> key(KEY_SIZE);
+    RAND_bytes(key.data(), key.size());
+    std::string path = (options.workdir / "encrypt.bin").string();
+    for (uint64_t size : sizes) {
+        std::string contents(size, 'x');
+        size_t iterations = std::clamp<uint64_t>(bytesPerSize / size, 5, options.quick ? 200 : 2000);
+        runBenchmark(options, results, "encrypt_file", {{"bytes", size}}, iterations, size,
+                     [&](size_t) { Encryption::encryptFile(path, contents, key); });
+        runBenchmark(options, results, "decrypt_file", {{"bytes", size}}, iterations, size,
+                     [&](size_t) { Encryption::decryptFile(path, nullStream, key); });
+    }
+    fs::remove(path);
+}
+
+/**
+ * FilenameRandomizer lookups against a metadata snapshot of the given size, laid out like a real tree: one
+ * user directory holding directories of BENCH_METADATA_FANOUT entries each.
+ */
+void benchMetadata(const BenchOptions& options, json& results, size_t entryCount) {
+    fs::path root = options.workdir / ("metadata_" + std::to_string(entryCount));
+    fs::create_directories(root / "common");
+    std::string rootPath = root.string();
+
+    std::mt19937_64 generator(entryCount);
+    std::map<std::string, std::string> entries;
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    std::vector<std::string> directories;
+    std::string userDirectory = randomName(generator);
+    entries[userDirectory] = "/filesystem/benchuser";
+    std::string parent;
+    while (entries.size() < entryCount) {
+        std::string key = randomName(generator);
+        if (entries.count(key) != 0) {
+            continue;
+        }
+        if (parent.empty() || (entries.size() % BENCH_METADATA_FANOUT) == 0) {
+            entries[key] = "/filesystem/" + userDirectory + "/dir" + std::to_string(directories.size());
+            parent = "/filesystem/" + userDirectory + "/" + key;
+            directories.push_back(parent);
+            continue;
+        }
+        std::string value = parent + "/file" + std::to_string(entries.size());
+        entries[key] = value;
+        keys.push_back(key);
+        values.push_back(value);
+    }
+    MetadataStore::Write((root / "common" / "structure.bin").string(), entries);
+    entries.clear();
+    FilenameRandomizer::LoadMetadata(rootPath);
+
+    std::vector<std::string> randomizedPaths;
+    for (size_t i = 0; i < std::min<size_t>(keys.size(), 4096); ++i) {
+        size_t pick = generator() % keys.size();
+        std::string path = values[pick];
+        // "/filesystem/<user>/<dir>/fileN" as randomized components below /filesystem
+        std::string dirKey = path.substr(path.find('/', 12) + 1, 10);
+        randomizedPaths.push_back(userDirectory + "/" + dirKey + "/" + keys[pick]);
+    }
+
+    json params = {{"entries", entryCount}};
+    size_t iterations = options.quick ? 2000 : 20000;
+    std::vector<size_t> order(iterations);
+    for (size_t& index : order) {
+        index = generator() % keys.size();
+    }
+
+    runBenchmark(options, results, "randomizer_get_filename", params, iterations, 0,
+                 [&](size_t i) { FilenameRandomizer::GetFilename(keys[order[i]], rootPath); });
+    runBenchmark(options, results, "randomizer_get_randomized_name", params, iterations, 0,
+                 [&](size_t i) { FilenameRandomizer::GetRandomizedName(values[order[i]], rootPath); });
+    runBenchmark(options, results, "randomizer_get_randomized_name_miss", params, iterations, 0,
+                 [&](size_t i) { FilenameRandomizer::GetRandomizedName(values[order[i]] + "_missing", rootPath); });
+
+    std::vector<std::string> batch(64);
+    runBenchmark(options, results, "randomizer_get_randomized_names_64", params, iterations / 64 + 1, 0, [&](size_t i) {
+        for (size_t j = 0; j < batch.size(); ++j) {
+            batch[j] = values[order[(i * batch.size() + j) % order.size()]];
+        }
+        FilenameRandomizer::GetRandomizedNames(batch, rootPath);
+    });
+    runBenchmark(options, results, "randomizer_get_plaintext_file_path", params, iterations, 0, [&](size_t i) {
+        FilenameRandomizer::GetPlaintextFilePath(randomizedPaths[i % randomizedPaths.size()], rootPath);
+    });
+    runBenchmark(options, results, "randomizer_list_children", params, std::min<size_t>(iterations / 10, 1000), 0,
+                 [&](size_t i) { FilenameRandomizer::ListChildren(directories[i % directories.size()], rootPath); });
+}
+
+/**
+ * Login and the session commands, run against a filesystem set up like `./fileserver` does on first start.
+ * The working directory is changed to the scratch filesystem for these, like the fileserver runs in its root.
+ */
+void benchSession(const BenchOptions& options, json& results) {
+    fs::path root = options.workdir / "filesystem_root";
+    fs::create_directories(root);
+    fs::path previous = fs::current_path();
+    fs::current_path(root);
+    std::string rootPath = root.string();
+
+    std::streambuf* out = std::cout.rdbuf(&nullBuffer);
+    initializeFilesystem(rootPath);
+    std::vector<std::string> peers;
+    for (int i = 0; i < BENCH_PEER_COUNT; ++i) {
+        peers.push_back("peer" + std::to_string(i));
+    }
+    std::vector<std::string> users = peers;
+    users.push_back("bench");
+    addUsers(users, rootPath);
+    std::cout.rdbuf(out);
+
+    Session session = createSession("bench", UserType::user, UserRegistry::Instance(rootPath).GetKey("bench"), rootPath);
+    std::string personal = "personal";
+    handleChangeDirectory(personal, session);
+    if (!isValidKeyfile("bench") || session.cwd.size() != 2) {
+        throw std::runtime_error("Setting up the benchmark filesystem failed");
+    }
+
+    size_t iterations = options.quick ? 50 : 500;
+    runBenchmark(options, results, "login", json::object(), options.quick ? 20 : 200, 0,
+                 [&](size_t) { isValidKeyfile("bench"); });
+
+    std::string contents(BENCH_FILE_CONTENT_SIZE, 'x');
+    size_t created = 0;
+    auto createFile = [&](size_t i) {
+        processFileCreation(parseCommandLine("mkfile file" + std::to_string(i) + " " + contents), session);
+        created++;
+    };
+    runBenchmark(options, results, "mkfile", {{"bytes", BENCH_FILE_CONTENT_SIZE}}, iterations, BENCH_FILE_CONTENT_SIZE,
+                 createFile);
+    // ls and share need the files even when mkfile itself is filtered out
+    std::streambuf* quiet = std::cout.rdbuf(&nullBuffer);
+    while (created < iterations) {
+        createFile(created);
+    }
+    processCreateDirectoryTree("a/b/c/d", session);
+    std::cout.rdbuf(quiet);
+
+    runBenchmark(options, results, "ls", {{"entries", iterations}}, iterations, 0,
+                 [&](size_t) { listDirectoryContents(session); });
+    runBenchmark(options, results, "share", {{"bytes", BENCH_FILE_CONTENT_SIZE}}, iterations, 0, [&](size_t i) {
+        handleFileSharing(parseCommandLine("share file" + std::to_string(i) + " " + peers[i % peers.size()]), session);
+    });
+    const std::string moves[] = {"a/b/c/d", "../..", "c/d", "../../../.."};
+    runBenchmark(options, results, "cd", {{"depth", 4}}, iterations * 4, 0, [&](size_t i) {
+        std::string target = moves[i % 4];
+        handleChangeDirectory(target, session);
+    });
+
+    fs::current_path(previous);
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--quick") {
+            options.quick = true;
+        } else if (argument == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (argument == "--output" && i + 1 < argc) {
+            options.outputPath = argv[++i];
+        } else if (argument == "--workdir" && i + 1 < argc) {
+            options.workdir = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--quick] [--filter <text>] [--output <file>] [--workdir <dir>]" << std::endl;
+        return 1;
+    }
+    fs::path scratchParent = options.workdir.empty() ? fs::temp_directory_path() : options.workdir;
+    options.workdir = fs::absolute(scratchParent / ("secfs_bench." + std::to_string(::getpid())));
+    fs::create_directories(options.workdir);
+
+    json results = json::array();
+    int exitCode = 0;
+    try {
+        benchEncryption(options, results);
+        std::vector<size_t> metadataSizes = {1000, 100000};
+        if (!options.quick) {
+            metadataSizes.push_back(1000000);
+        }
+        for (size_t entryCount : metadataSizes) {
+            benchMetadata(options, results, entryCount);
+        }
+        benchSession(options, results);
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        exitCode = 1;
+    }
+    fs::remove_all(options.workdir);
+
+    json report = {
+        {"schema", "secfs-bench/1"},
+        {"timestamp", static_cast<int64_t>(std::time(nullptr))},
+        {"quick", options.quick},
+        {"crypto_workers", Encryption::workerCount()},
+        {"results", results},
+    };
+    if (options.outputPath.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream output(options.outputPath);
+        output << report.dump(2) << std::endl;
+        if (!output) {
+            std::cerr << "Failed to write " << options.outputPath << std::endl;
+            return 1;
+        }
+    }
+    return exitCode;
+}
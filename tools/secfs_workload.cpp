@@ -0,0 +1,626 @@
+/*
+* Workload generator and replay for sizing deployments. Builds a scratch filesystem with --users users, each
+* with a personal tree of --depth levels of --fanout directories holding --files files whose sizes are drawn
+* from --file-size, and shares --shares files per user with other users. Then replays a mix of cd, ls, cat,
+* mkfile and share through executeCommand, the dispatch the session loop uses, and reports ops/s and a latency
+* histogram per operation as JSON on stdout.
+*
+* The operations are generated from --ops and --mix, or read from a trace: one "<user>\t<session line>" per
+* line. --record writes the generated trace, starting with a comment holding the build options, and --replay
+* reads one back and rebuilds the same filesystem from that comment. Everything random is drawn from --seed,
+* so the same options give the same filesystem and the same operations.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "authentication/authentication.h"
+#include "encryption/encryption.h"
+#include "helpers/json.hpp"
+#include "secfs.h"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+#define WORKLOAD_TRACE_HEADER "# secfs-workload"
+#define WORKLOAD_MAX_CD_DEPTH 2 // levels one generated cd moves down at most
+
+// What the filesystem is built from; recorded in traces so a replay rebuilds the same one
+struct BuildOptions {
+    size_t users = 8;
+    size_t depth = 3;
+    size_t fanout = 3;
+    size_t files = 2;
+    uint64_t minFileSize = 256; //bytes
+    uint64_t maxFileSize = 64 * 1024; //bytes
+    size_t shares = 4;
+    uint64_t seed = 1;
+};
+
+struct WorkloadOptions {
+    BuildOptions build;
+    size_t ops = 10000;
+    std::map<std::string, double> mix = {{"cd", 25}, {"ls", 25}, {"cat", 30}, {"mkfile", 10}, {"share", 10}};
+    std::string recordPath;
+    std::string replayPath;
+    std::string outputPath;
+    fs::path workdir;
+};
+
+// Swallows what the feature functions print while they are being timed
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+NullBuffer nullBuffer;
+
+// Sends std::cout to nullBuffer until it goes out of scope, also when a command throws
+class QuietOutput {
+public:
+    QuietOutput() : previous_(std::cout.rdbuf(&nullBuffer)) {}
+    ~QuietOutput() { std::cout.rdbuf(previous_); }
+    QuietOutput(const QuietOutput&) = delete;
+    QuietOutput& operator=(const QuietOutput&) = delete;
+
+private:
+    std::streambuf* previous_;
+};
+
+// The generator's picture of one user's files. Directories are keyed by their path below the user's root,
+// "" for the root itself, "personal/d0" for a directory below personal
+struct DirectoryModel {
+    std::vector<std::string> children;
+    std::vector<std::string> files;
+};
+
+struct UserModel {
+    std::string name;
+    std::map<std::string, DirectoryModel> directories;
+    std::string cwd;
+};
+
+struct WorkloadModel {
+    std::vector<UserModel> users;
+    // "<file>\t<user>" for every file shared so far; file names are unique across users
+    std::set<std::string> shared;
+    size_t fileCount = 0;
+};
+
+struct TraceEntry {
+    std::string user;
+    std::string line;
+};
+
+bool isPersonal(const std::string& path) {
+    return path == "personal" || path.rfind("personal/", 0) == 0;
+}
+
+std::string joinPath(const std::string& parent, const std::string& name) {
+    return parent.empty() ? name : parent + "/" + name;
+}
+
+std::string parentPath(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "" : path.substr(0, slash);
+}
+
+size_t pathDepth(const std::string& path) {
+    return path.empty() ? 0 : std::count(path.begin(), path.end(), '/') + 1;
+}
+
+template <typename Items>
+auto& pickOne(Items& items, std::mt19937_64& generator) {
+    return items[std::uniform_int_distribution<size_t>(0, items.size() - 1)(generator)];
+}
+
+/**
+ * Draws a file size, log-uniform between the bounds so small files are as common as in most trees.
+ */
+uint64_t drawFileSize(const BuildOptions& options, std::mt19937_64& generator) {
+    if (options.minFileSize >= options.maxFileSize) {
+        return options.minFileSize;
+    }
+    std::uniform_real_distribution<double> exponent(std::log(static_cast<double>(std::max<uint64_t>(options.minFileSize, 1))),
+                                                    std::log(static_cast<double>(options.maxFileSize)));
+    return std::clamp<uint64_t>(std::llround(std::exp(exponent(generator))), options.minFileSize, options.maxFileSize);
+}
+
+/**
+ * A new file for the user's current directory: a name unique across the filesystem and its mkfile line.
+ */
+std::string newFileLine(WorkloadModel& model, UserModel& user, const BuildOptions& options, std::mt19937_64& generator) {
+    std::string name = "f" + std::to_string(model.fileCount++);
+    user.directories[user.cwd].files.push_back(name);
+    return "mkfile " + name + " " + std::string(drawFileSize(options, generator), 'a' + model.fileCount % 26);
+}
+
+/**
+ * A share of a file in the user's current directory with another user, preferring one it isn't shared with.
+ */
+std::string newShareLine(WorkloadModel& model, UserModel& user, std::mt19937_64& generator) {
+    const std::string& file = pickOne(user.directories[user.cwd].files, generator);
+    std::vector<UserModel*> targets;
+    for (UserModel& target : model.users) {
+        if (&target != &user && !model.shared.count(file + "\t" + target.name)) {
+            targets.push_back(&target);
+        }
+    }
+    // Shared with everyone already: share again, which the session answers without touching the file
+    UserModel* target = targets.empty() ? &model.users[(&user - &model.users[0] + 1) % model.users.size()]
+                                        : pickOne(targets, generator);
+    if (model.shared.insert(file + "\t" + target->name).second) {
+        target->directories["shared"].files.push_back(file);
+    }
+    return "share " + file + " " + target->name;
+}
+
+/**
+ * A cd that moves the user up or down their tree, never both in one path.
+ */
+std::string newChangeDirectoryLine(UserModel& user, std::mt19937_64& generator) {
+    const DirectoryModel& current = user.directories[user.cwd];
+    size_t depth = pathDepth(user.cwd);
+    bool down = !current.children.empty() && (depth == 0 || std::bernoulli_distribution(0.5)(generator));
+    if (!down) {
+        size_t levels = std::uniform_int_distribution<size_t>(1, depth)(generator);
+        if (levels == depth && std::bernoulli_distribution(0.5)(generator)) {
+            user.cwd.clear();
+            return "cd /";
+        }
+        std::string line = "cd ..";
+        user.cwd = parentPath(user.cwd);
+        for (size_t i = 1; i < levels; ++i) {
+            line += "/..";
+            user.cwd = parentPath(user.cwd);
+        }
+        return line;
+    }
+
+    std::string relative;
+    size_t levels = std::uniform_int_distribution<size_t>(1, WORKLOAD_MAX_CD_DEPTH)(generator);
+    for (size_t i = 0; i < levels && !user.directories[user.cwd].children.empty(); ++i) {
+        const std::string& child = pickOne(user.directories[user.cwd].children, generator);
+        relative = joinPath(relative, child);
+        user.cwd = joinPath(user.cwd, child);
+    }
+    return "cd " + relative;
+}
+
+/**
+ * Generates the operations: a random user per operation and an operation drawn from the mix among those that
+ * make sense where that user is. cat and share need a file in the directory, mkfile and share a personal one,
+ * share another user.
+ */
+std::vector<TraceEntry> generateTrace(WorkloadModel& model, const WorkloadOptions& options) {
+    std::mt19937_64 generator(options.build.seed + 1);
+    std::vector<TraceEntry> trace;
+    trace.reserve(options.ops);
+    for (size_t i = 0; i < options.ops; ++i) {
+        UserModel& user = pickOne(model.users, generator);
+        const DirectoryModel& current = user.directories[user.cwd];
+        bool personal = isPersonal(user.cwd);
+
+        std::vector<std::string> names;
+        std::vector<double> weights;
+        for (const auto& [name, weight] : options.mix) {
+            bool applicable = name == "cd" || name == "ls" || (name == "cat" && !current.files.empty()) ||
+                              (name == "mkfile" && personal) ||
+                              (name == "share" && personal && !current.files.empty() && model.users.size() > 1);
+            if (applicable && weight > 0) {
+                names.push_back(name);
+                weights.push_back(weight);
+            }
+        }
+        if (names.empty()) {
+            names.push_back("cd");
+            weights.push_back(1);
+        }
+        const std::string& operation = names[std::discrete_distribution<size_t>(weights.begin(), weights.end())(generator)];
+
+        std::string line;
+        if (operation == "cd") {
+            line = newChangeDirectoryLine(user, generator);
+        } else if (operation == "ls") {
+            line = "ls";
+        } else if (operation == "cat") {
+            line = "cat " + pickOne(current.files, generator);
+        } else if (operation == "mkfile") {
+            line = newFileLine(model, user, options.build, generator);
+        } else {
+            line = newShareLine(model, user, generator);
+        }
+        trace.push_back({user.name, line});
+    }
+    return trace;
+}
+
+/**
+ * Runs a session line and fails the build if it didn't run, setting up must not silently produce less.
+ */
+void runBuildCommand(Session& session, const std::string& text) {
+    CommandResult result = executeCommand(parseCommandLine(text), session);
+    if (result != CommandResult::ok) {
+        throw std::runtime_error("Building the workload filesystem failed at \"" + text.substr(0, 64) + "\"");
+    }
+}
+
+/**
+ * Creates the users, their directory trees and files and the share graph, recording all of it in the model.
+ * The working directory is changed to the filesystem, like the fileserver runs in its root.
+ *
+ * @return The counts of what was created and how long it took.
+ */
+json buildFilesystem(const BuildOptions& options, const std::string& rootPath, WorkloadModel& model,
+                     std::map<std::string, Session>& sessions) {
+    auto started = std::chrono::steady_clock::now();
+    std::mt19937_64 generator(options.seed);
+    QuietOutput quiet;
+
+    initializeFilesystem(rootPath);
+    std::vector<std::string> userNames;
+    for (size_t i = 0; i < options.users; ++i) {
+        userNames.push_back("user" + std::to_string(i));
+    }
+    if (addUsers(userNames, rootPath) != userNames.size()) {
+        throw std::runtime_error("Adding the workload users failed");
+    }
+
+    size_t directoryCount = 0;
+    for (const std::string& userName : userNames) {
+        UserModel user{userName, {}, ""};
+        user.directories[""].children = {"personal", "shared"};
+        user.directories["personal"];
+        std::vector<std::string> level = {"personal"};
+        for (size_t depth = 0; depth < options.depth; ++depth) {
+            std::vector<std::string> next;
+            for (const std::string& parent : level) {
+                for (size_t i = 0; i < options.fanout; ++i) {
+                    std::string child = joinPath(parent, "d" + std::to_string(i));
+                    user.directories[parent].children.push_back("d" + std::to_string(i));
+                    user.directories[child];
+                    next.push_back(child);
+                }
+            }
+            level = next;
+        }
+        user.directories["shared"];
+
+        Session& session = sessions.emplace(userName, createSession(userName, UserType::user,
+                                                                      UserRegistry::Instance(rootPath).GetKey(userName),
+                                                                      rootPath)).first->second;
+        // The leaves, each with its missing parents
+        for (const std::string& leaf : level) {
+            if (leaf != "personal") {
+                runBuildCommand(session, "cd personal");
+                runBuildCommand(session, "mkdir -p " + leaf.substr(std::string("personal/").size()));
+                runBuildCommand(session, "cd /");
+            }
+        }
+        model.users.push_back(user);
+        directoryCount += user.directories.size() - 2;
+    }
+
+    for (UserModel& user : model.users) {
+        Session& session = sessions.at(user.name);
+        for (auto& [path, directory] : user.directories) {
+            if (!isPersonal(path)) {
+                continue;
+            }
+            runBuildCommand(session, "cd " + path);
+            user.cwd = path;
+            for (size_t i = 0; i < options.files; ++i) {
+                runBuildCommand(session, newFileLine(model, user, options, generator));
+            }
+            runBuildCommand(session, "cd /");
+        }
+    }
+
+    size_t shareCount = 0;
+    for (UserModel& user : model.users) {
+        std::vector<std::string> withFiles;
+        for (const auto& [path, directory] : user.directories) {
+            if (isPersonal(path) && !directory.files.empty()) {
+                withFiles.push_back(path);
+            }
+        }
+        for (size_t i = 0; i < options.shares && options.users > 1 && !withFiles.empty(); ++i) {
+            user.cwd = pickOne(withFiles, generator);
+            runBuildCommand(sessions.at(user.name), "cd " + user.cwd);
+            runBuildCommand(sessions.at(user.name), newShareLine(model, user, generator));
+            runBuildCommand(sessions.at(user.name), "cd /");
+            shareCount++;
+        }
+        user.cwd.clear();
+    }
+
+    return {
+        {"users", options.users},
+        {"directories", directoryCount},
+        {"files", model.fileCount},
+        {"shares", shareCount},
+        {"total_s", std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count()},
+    };
+}
+
+/**
+ * Nearest-rank percentile of sorted samples.
+ */
+double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+/**
+ * Summarizes the latencies of one operation: throughput while running it, percentiles and a histogram with
+ * power-of-two buckets, each counting the samples below its le_us and at or above the previous one's.
+ */
+json summarize(const std::string& name, std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    json histogram = json::array();
+    size_t next = 0;
+    for (double bound = 1; next < samples.size(); bound *= 2) {
+        size_t count = 0;
+        for (; next < samples.size() && samples[next] < bound; ++next) {
+            count++;
+        }
+        histogram.push_back({{"le_us", bound}, {"count", count}});
+    }
+    return {
+        {"name", name},
+        {"count", samples.size()},
+        {"busy_s", sum / 1e6},
+        {"ops_per_s", samples.size() / (sum / 1e6)},
+        {"mean_us", sum / samples.size()},
+        {"p50_us", percentile(samples, 0.50)},
+        {"p90_us", percentile(samples, 0.90)},
+        {"p99_us", percentile(samples, 0.99)},
+        {"max_us", samples.back()},
+        {"histogram", histogram},
+    };
+}
+
+/**
+ * Replays the trace, timing each line on its own. Every user has one session for the whole replay, so their
+ * working directory carries over from one of their lines to the next.
+ */
+json replayTrace(const std::vector<TraceEntry>& trace, std::map<std::string, Session>& sessions) {
+    std::map<std::string, std::vector<double>> samples;
+    std::map<std::string, size_t> results;
+    static const char* resultNames[] = {"ok", "failed", "invalid", "usage", "exit"};
+
+    QuietOutput quiet;
+    auto started = std::chrono::steady_clock::now();
+    for (const TraceEntry& entry : trace) {
+        auto session = sessions.find(entry.user);
+        if (session == sessions.end()) {
+            throw std::runtime_error("The trace uses unknown user " + entry.user);
+        }
+        CommandLine line = parseCommandLine(entry.line);
+        auto begin = std::chrono::steady_clock::now();
+        CommandResult result = executeCommand(line, session->second);
+        double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        samples[line.words.empty() ? "" : line.words[0]].push_back(elapsed);
+        samples["all"].push_back(elapsed);
+        results[resultNames[static_cast<int>(result)]]++;
+    }
+    double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    json operations = json::array();
+    for (const auto& [name, latencies] : samples) {
+        operations.push_back(summarize(name, latencies));
+    }
+    return {
+        {"ops", trace.size()},
+        {"total_s", totalSeconds},
+        {"ops_per_s", trace.size() / totalSeconds},
+        {"results", results},
+        {"operations", operations},
+    };
+}
+
+/**
+ * The build options as arguments, written at the top of a recorded trace.
+ */
+std::string buildArguments(const BuildOptions& options) {
+    return "--users " + std::to_string(options.users) + " --depth " + std::to_string(options.depth) +
+           " --fanout " + std::to_string(options.fanout) + " --files " + std::to_string(options.files) +
+           " --file-size " + std::to_string(options.minFileSize) + "-" + std::to_string(options.maxFileSize) +
+           " --shares " + std::to_string(options.shares) + " --seed " + std::to_string(options.seed);
+}
+
+/**
+ * Parses "<bytes>" or "<min>-<max>" for --file-size.
+ */
+void parseFileSize(const std::string& text, BuildOptions& options) {
+    size_t dash = text.find('-');
+    options.minFileSize = std::stoull(text.substr(0, dash));
+    options.maxFileSize = dash == std::string::npos ? options.minFileSize : std::stoull(text.substr(dash + 1));
+    if (options.minFileSize == 0 || options.minFileSize > options.maxFileSize) {
+        throw std::invalid_argument(text);
+    }
+}
+
+/**
+ * Parses "<operation>=<weight>,..." for --mix. Operations left out aren't run.
+ */
+void parseMix(const std::string& text, std::map<std::string, double>& mix) {
+    std::map<std::string, double> parsed;
+    std::stringstream items(text);
+    std::string item;
+    while (getline(items, item, ',')) {
+        size_t equals = item.find('=');
+        std::string name = item.substr(0, equals);
+        if (equals == std::string::npos || !mix.count(name)) {
+            throw std::invalid_argument(item);
+        }
+        parsed[name] = std::stod(item.substr(equals + 1));
+    }
+    mix = parsed;
+}
+
+bool parseOptions(const std::vector<std::string>& arguments, WorkloadOptions& options) {
+    try {
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            const std::string& argument = arguments[i];
+            if (i + 1 >= arguments.size()) {
+                return false;
+            }
+            const std::string& value = arguments[++i];
+            if (argument == "--users") {
+                options.build.users = std::stoul(value);
+            } else if (argument == "--depth") {
+                options.build.depth = std::stoul(value);
+            } else if (argument == "--fanout") {
+                options.build.fanout = std::stoul(value);
+            } else if (argument == "--files") {
+                options.build.files = std::stoul(value);
+            } else if (argument == "--file-size") {
+                parseFileSize(value, options.build);
+            } else if (argument == "--shares") {
+                options.build.shares = std::stoul(value);
+            } else if (argument == "--seed") {
+                options.build.seed = std::stoull(value);
+            } else if (argument == "--ops") {
+                options.ops = std::stoul(value);
+            } else if (argument == "--mix") {
+                parseMix(value, options.mix);
+            } else if (argument == "--record") {
+                options.recordPath = value;
+            } else if (argument == "--replay") {
+                options.replayPath = value;
+            } else if (argument == "--output") {
+                options.outputPath = value;
+            } else if (argument == "--workdir") {
+                options.workdir = value;
+            } else {
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        return false;
+    }
+    return options.build.users > 0;
+}
+
+/**
+ * Reads a trace, taking the build options from its header comment if it has one.
+ *
+ * @return false if the file can't be read or a line or the header is malformed.
+ */
+bool readTrace(const std::string& path, BuildOptions& build, std::vector<TraceEntry>& trace) {
+    std::ifstream input(path);
+    if (!input) {
+        return false;
+    }
+    std::string text;
+    while (getline(input, text)) {
+        if (text.rfind(WORKLOAD_TRACE_HEADER " ", 0) == 0) {
+            WorkloadOptions recorded;
+            if (!parseOptions(parseCommandLine(text.substr(sizeof(WORKLOAD_TRACE_HEADER))).words, recorded)) {
+                return false;
+            }
+            build = recorded.build;
+            continue;
+        }
+        if (text.empty() || text[0] == '#') {
+            continue;
+        }
+        size_t tab = text.find('\t');
+        if (tab == std::string::npos) {
+            return false;
+        }
+        trace.push_back({text.substr(0, tab), text.substr(tab + 1)});
+    }
+    return true;
+}
+
+bool writeTrace(const std::string& path, const BuildOptions& build, const std::vector<TraceEntry>& trace) {
+    std::ofstream output(path);
+    output << WORKLOAD_TRACE_HEADER << " " << buildArguments(build) << "\n";
+    for (const TraceEntry& entry : trace) {
+        output << entry.user << "\t" << entry.line << "\n";
+    }
+    return static_cast<bool>(output);
+}
+
+int main(int argc, char* argv[]) {
+    WorkloadOptions options;
+    if (!parseOptions(std::vector<std::string>(argv + 1, argv + argc), options)) {
+        std::cerr << "Usage: " << argv[0] << " [--users <n>] [--depth <n>] [--fanout <n>] [--files <n>]"
+                  << " [--file-size <bytes>|<min>-<max>] [--shares <n>] [--seed <n>] [--ops <n>]"
+                  << " [--mix cd=<w>,ls=<w>,cat=<w>,mkfile=<w>,share=<w>] [--record <file>] [--replay <file>]"
+                  << " [--output <file>] [--workdir <dir>]" << std::endl;
+        return 1;
+    }
+    std::vector<TraceEntry> trace;
+    if (!options.replayPath.empty() && !readTrace(options.replayPath, options.build, trace)) {
+        std::cerr << "Failed to read trace " << options.replayPath << std::endl;
+        return 1;
+    }
+
+    fs::path scratchParent = options.workdir.empty() ? fs::temp_directory_path() : options.workdir;
+    fs::path root = fs::absolute(scratchParent / ("secfs_workload." + std::to_string(::getpid())));
+    fs::create_directories(root);
+    fs::path previous = fs::current_path();
+    fs::current_path(root);
+
+    int exitCode = 0;
+    json report = {
+        {"schema", "secfs-workload/1"},
+        {"timestamp", static_cast<int64_t>(std::time(nullptr))},
+        {"crypto_workers", Encryption::workerCount()},
+        {"options", buildArguments(options.build)},
+    };
+    try {
+        WorkloadModel model;
+        std::map<std::string, Session> sessions;
+        std::cerr << "workload: building " << buildArguments(options.build) << std::endl;
+        report["build"] = buildFilesystem(options.build, root.string(), model, sessions);
+
+        if (options.replayPath.empty()) {
+            trace = generateTrace(model, options);
+            report["mix"] = options.mix;
+        }
+        if (!options.recordPath.empty() && !writeTrace(options.recordPath, options.build, trace)) {
+            throw std::runtime_error("Failed to write trace " + options.recordPath);
+        }
+        std::cerr << "workload: replaying " << trace.size() << " operations" << std::endl;
+        report["replay"] = replayTrace(trace, sessions);
+    } catch (const std::exception& e) {
+        std::cerr << "Workload failed: " << e.what() << std::endl;
+        exitCode = 1;
+    }
+    fs::current_path(previous);
+    fs::remove_all(root);
+
+    if (options.outputPath.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream output(options.outputPath);
+        output << report.dump(2) << std::endl;
+        if (!output) {
+            std::cerr << "Failed to write " << options.outputPath << std::endl;
+            return 1;
+        }
+    }
+    return exitCode;
+}